@@ -0,0 +1,1878 @@
+#include "audio-dsp.h"
+#include <obs.h>
+#include <util/threading.h>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AUDIO_DSP_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define AUDIO_DSP_TARGET(isa)
+#else
+#define AUDIO_DSP_TARGET(isa) __attribute__((target(isa)))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define AUDIO_DSP_NEON
+#include <arm_neon.h>
+#endif
+
+/* Kernels are templates on the channel count so the loops over channels of the layouts we run most, mono, stereo,
+ * 5.1 and 7.1, unroll into straight vector code. Channels 0 is the fallback that reads the counts at runtime, it is
+ * also the only kernel that handles a matrix with different input and output counts.
+ *
+ * The gain kernels handle a matrix that only has a diagonal, pattern holds the gains of 8 frames so every vector of
+ * a block of frames starts on a known channel. The mix kernels handle a full matrix, every input channel is
+ * multiplied with its column and summed into the outputs. Frames are interleaved, in and out can be the same buffer
+ * when the counts are equal. */
+template<uint32_t Channels> static inline uint32_t audio_dsp_channels(uint32_t channels)
+{
+	return Channels ? Channels : channels;
+}
+
+template<uint32_t Channels> struct audio_dsp_gain_scalar {
+	static void run(const struct audio_dsp_matrix *matrix, const float *in, float *out, size_t frames)
+	{
+		const uint32_t count = audio_dsp_channels<Channels>(matrix->out_channels);
+		for (size_t frame = 0; frame < frames; frame++) {
+			const size_t first = frame * count;
+			for (uint32_t channel = 0; channel < count; channel++)
+				out[first + channel] = in[first + channel] * matrix->pattern[channel];
+		}
+	}
+};
+
+template<uint32_t Channels> struct audio_dsp_mix_scalar {
+	static void run(const struct audio_dsp_matrix *matrix, const float *in, float *out, size_t frames)
+	{
+		const uint32_t inputs = audio_dsp_channels<Channels>(matrix->in_channels);
+		const uint32_t outputs = audio_dsp_channels<Channels>(matrix->out_channels);
+		for (size_t frame = 0; frame < frames; frame++) {
+			const float *src = in + frame * inputs;
+			float mixed[MAX_AUDIO_CHANNELS] = {0};
+			for (uint32_t i = 0; i < inputs; i++) {
+				for (uint32_t o = 0; o < outputs; o++)
+					mixed[o] += src[i] * matrix->columns[i][o];
+			}
+			for (uint32_t o = 0; o < outputs; o++)
+				out[frame * outputs + o] = mixed[o];
+		}
+	}
+};
+
+#ifdef AUDIO_DSP_X86
+template<uint32_t Channels> struct audio_dsp_gain_sse2 {
+	AUDIO_DSP_TARGET("sse2")
+	static void run(const struct audio_dsp_matrix *matrix, const float *in, float *out, size_t frames)
+	{
+		// 4 frames are exactly channels vectors of 4 samples.
+		const uint32_t count = audio_dsp_channels<Channels>(matrix->out_channels);
+		const float *pattern = matrix->pattern;
+		const size_t samples = frames * count;
+		const size_t block = 4 * count;
+		size_t i = 0;
+		for (; i + block <= samples; i += block) {
+			for (uint32_t v = 0; v < count; v++)
+				_mm_storeu_ps(out + i + v * 4,
+					      _mm_mul_ps(_mm_loadu_ps(in + i + v * 4), _mm_loadu_ps(pattern + v * 4)));
+		}
+		audio_dsp_gain_scalar<Channels>::run(matrix, in + i, out + i, (samples - i) / count);
+	}
+};
+
+template<uint32_t Channels> struct audio_dsp_gain_avx2 {
+	AUDIO_DSP_TARGET("avx2")
+	static void run(const struct audio_dsp_matrix *matrix, const float *in, float *out, size_t frames)
+	{
+		const uint32_t count = audio_dsp_channels<Channels>(matrix->out_channels);
+		const float *pattern = matrix->pattern;
+		const size_t samples = frames * count;
+		const size_t block = 8 * count;
+		size_t i = 0;
+		for (; i + block <= samples; i += block) {
+			for (uint32_t v = 0; v < count; v++)
+				_mm256_storeu_ps(out + i + v * 8,
+						 _mm256_mul_ps(_mm256_loadu_ps(in + i + v * 8), _mm256_loadu_ps(pattern + v * 8)));
+		}
+		audio_dsp_gain_scalar<Channels>::run(matrix, in + i, out + i, (samples - i) / count);
+	}
+};
+
+/* Stereo duplicates each input across the lanes of its frame, 7.1 broadcasts every input against its column,
+ * other layouts use the unrolled scalar loop */
+template<uint32_t Channels> struct audio_dsp_mix_sse2 {
+	AUDIO_DSP_TARGET("sse2")
+	static void run(const struct audio_dsp_matrix *matrix, const float *in, float *out, size_t frames)
+	{
+		if constexpr (Channels == 2) {
+			const __m128 left = _mm_loadu_ps(matrix->columns[0]);
+			const __m128 right = _mm_loadu_ps(matrix->columns[1]);
+			size_t i = 0;
+			for (; i + 4 <= frames * 2; i += 4) {
+				const __m128 v = _mm_loadu_ps(in + i);
+				const __m128 l = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 0, 0));
+				const __m128 r = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 1, 1));
+				_mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(l, left), _mm_mul_ps(r, right)));
+			}
+			audio_dsp_mix_scalar<2>::run(matrix, in + i, out + i, frames - i / 2);
+		} else if constexpr (Channels == 8) {
+			for (size_t frame = 0; frame < frames; frame++) {
+				const float *src = in + frame * 8;
+				__m128 lo = _mm_setzero_ps();
+				__m128 hi = _mm_setzero_ps();
+				for (uint32_t i = 0; i < 8; i++) {
+					const __m128 s = _mm_set1_ps(src[i]);
+					lo = _mm_add_ps(lo, _mm_mul_ps(s, _mm_loadu_ps(matrix->columns[i])));
+					hi = _mm_add_ps(hi, _mm_mul_ps(s, _mm_loadu_ps(matrix->columns[i] + 4)));
+				}
+				_mm_storeu_ps(out + frame * 8, lo);
+				_mm_storeu_ps(out + frame * 8 + 4, hi);
+			}
+		} else {
+			audio_dsp_mix_scalar<Channels>::run(matrix, in, out, frames);
+		}
+	}
+};
+
+template<uint32_t Channels> struct audio_dsp_mix_avx2 {
+	AUDIO_DSP_TARGET("avx2")
+	static void run(const struct audio_dsp_matrix *matrix, const float *in, float *out, size_t frames)
+	{
+		if constexpr (Channels == 2) {
+			const __m256 left = _mm256_loadu_ps(matrix->columns[0]);
+			const __m256 right = _mm256_loadu_ps(matrix->columns[1]);
+			size_t i = 0;
+			for (; i + 8 <= frames * 2; i += 8) {
+				const __m256 v = _mm256_loadu_ps(in + i);
+				const __m256 l = _mm256_permute_ps(v, _MM_SHUFFLE(2, 2, 0, 0));
+				const __m256 r = _mm256_permute_ps(v, _MM_SHUFFLE(3, 3, 1, 1));
+				_mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(l, left), _mm256_mul_ps(r, right)));
+			}
+			audio_dsp_mix_scalar<2>::run(matrix, in + i, out + i, frames - i / 2);
+		} else if constexpr (Channels == 8) {
+			for (size_t frame = 0; frame < frames; frame++) {
+				const float *src = in + frame * 8;
+				__m256 mixed = _mm256_setzero_ps();
+				for (uint32_t i = 0; i < 8; i++) {
+					const __m256 s = _mm256_set1_ps(src[i]);
+					mixed = _mm256_add_ps(mixed, _mm256_mul_ps(s, _mm256_loadu_ps(matrix->columns[i])));
+				}
+				_mm256_storeu_ps(out + frame * 8, mixed);
+			}
+		} else {
+			audio_dsp_mix_scalar<Channels>::run(matrix, in, out, frames);
+		}
+	}
+};
+
+static bool audio_dsp_cpu_has(bool avx2)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 0);
+	const int max_leaf = info[0];
+	__cpuid(info, 1);
+	if (!avx2)
+		return (info[3] & (1 << 26)) != 0;
+	// AVX also needs the OS to save the ymm registers.
+	if (max_leaf < 7 || !(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return avx2 ? __builtin_cpu_supports("avx2") : __builtin_cpu_supports("sse2");
+#endif
+}
+#endif
+
+#ifdef AUDIO_DSP_NEON
+template<uint32_t Channels> struct audio_dsp_gain_neon {
+	static void run(const struct audio_dsp_matrix *matrix, const float *in, float *out, size_t frames)
+	{
+		const uint32_t count = audio_dsp_channels<Channels>(matrix->out_channels);
+		const float *pattern = matrix->pattern;
+		const size_t samples = frames * count;
+		const size_t block = 4 * count;
+		size_t i = 0;
+		for (; i + block <= samples; i += block) {
+			for (uint32_t v = 0; v < count; v++)
+				vst1q_f32(out + i + v * 4, vmulq_f32(vld1q_f32(in + i + v * 4), vld1q_f32(pattern + v * 4)));
+		}
+		audio_dsp_gain_scalar<Channels>::run(matrix, in + i, out + i, (samples - i) / count);
+	}
+};
+
+template<uint32_t Channels> struct audio_dsp_mix_neon {
+	static void run(const struct audio_dsp_matrix *matrix, const float *in, float *out, size_t frames)
+	{
+		if constexpr (Channels == 2) {
+			// Deinterleaving loads give 4 frames of each channel.
+			const float ll = matrix->columns[0][0];
+			const float lr = matrix->columns[0][1];
+			const float rl = matrix->columns[1][0];
+			const float rr = matrix->columns[1][1];
+			size_t i = 0;
+			for (; i + 8 <= frames * 2; i += 8) {
+				const float32x4x2_t v = vld2q_f32(in + i);
+				float32x4x2_t mixed;
+				mixed.val[0] = vmlaq_n_f32(vmulq_n_f32(v.val[0], ll), v.val[1], rl);
+				mixed.val[1] = vmlaq_n_f32(vmulq_n_f32(v.val[0], lr), v.val[1], rr);
+				vst2q_f32(out + i, mixed);
+			}
+			audio_dsp_mix_scalar<2>::run(matrix, in + i, out + i, frames - i / 2);
+		} else if constexpr (Channels == 8) {
+			for (size_t frame = 0; frame < frames; frame++) {
+				const float *src = in + frame * 8;
+				float32x4_t lo = vdupq_n_f32(0.0f);
+				float32x4_t hi = vdupq_n_f32(0.0f);
+				for (uint32_t i = 0; i < 8; i++) {
+					lo = vmlaq_n_f32(lo, vld1q_f32(matrix->columns[i]), src[i]);
+					hi = vmlaq_n_f32(hi, vld1q_f32(matrix->columns[i] + 4), src[i]);
+				}
+				vst1q_f32(out + frame * 8, lo);
+				vst1q_f32(out + frame * 8 + 4, hi);
+			}
+		} else {
+			audio_dsp_mix_scalar<Channels>::run(matrix, in, out, frames);
+		}
+	}
+};
+#endif
+
+/* The instantiation of a kernel for a channel count, layouts without a specialization get the runtime loop */
+template<template<uint32_t> class Kernel> static auto audio_dsp_specialize(uint32_t channels) -> decltype(&Kernel<0>::run)
+{
+	switch (channels) {
+	case 1:
+		return Kernel<1>::run;
+	case 2:
+		return Kernel<2>::run;
+	case 6:
+		return Kernel<6>::run;
+	case 8:
+		return Kernel<8>::run;
+	default:
+		return Kernel<0>::run;
+	}
+}
+
+enum audio_dsp_isa {
+	AUDIO_DSP_ISA_SCALAR,
+	AUDIO_DSP_ISA_SSE2,
+	AUDIO_DSP_ISA_AVX2,
+	AUDIO_DSP_ISA_NEON,
+};
+
+static audio_dsp_isa audio_dsp_gain_isa = AUDIO_DSP_ISA_SCALAR;
+static audio_dsp_isa audio_dsp_convert_isa = AUDIO_DSP_ISA_SCALAR;
+static const char *audio_dsp_kernel_name = "scalar";
+
+static audio_dsp_matrix_func audio_dsp_get_kernel(uint32_t channels, bool diagonal)
+{
+	switch (audio_dsp_gain_isa) {
+#ifdef AUDIO_DSP_X86
+	case AUDIO_DSP_ISA_AVX2:
+		return diagonal ? audio_dsp_specialize<audio_dsp_gain_avx2>(channels)
+				: audio_dsp_specialize<audio_dsp_mix_avx2>(channels);
+	case AUDIO_DSP_ISA_SSE2:
+		return diagonal ? audio_dsp_specialize<audio_dsp_gain_sse2>(channels)
+				: audio_dsp_specialize<audio_dsp_mix_sse2>(channels);
+#endif
+#ifdef AUDIO_DSP_NEON
+	case AUDIO_DSP_ISA_NEON:
+		return diagonal ? audio_dsp_specialize<audio_dsp_gain_neon>(channels)
+				: audio_dsp_specialize<audio_dsp_mix_neon>(channels);
+#endif
+	default:
+		return diagonal ? audio_dsp_specialize<audio_dsp_gain_scalar>(channels)
+				: audio_dsp_specialize<audio_dsp_mix_scalar>(channels);
+	}
+}
+
+void audio_dsp_matrix_set(struct audio_dsp_matrix *matrix, uint32_t in_channels, uint32_t out_channels, const float *coefficients)
+{
+	if (!in_channels || !out_channels || in_channels > MAX_AUDIO_CHANNELS || out_channels > MAX_AUDIO_CHANNELS) {
+		matrix->in_channels = 0;
+		matrix->out_channels = 0;
+		matrix->kernel = nullptr;
+		return;
+	}
+
+	bool diagonal = in_channels == out_channels;
+	for (uint32_t i = 0; i < in_channels; i++) {
+		for (uint32_t k = 0; k < 8; k++) {
+			const uint32_t o = k % out_channels;
+			matrix->columns[i][k] = coefficients[o * in_channels + i];
+			if (o != i && coefficients[o * in_channels + i] != 0.0f)
+				diagonal = false;
+		}
+	}
+	if (diagonal) {
+		for (uint32_t k = 0; k < out_channels * 8; k++)
+			matrix->pattern[k] = matrix->columns[k % out_channels][k % out_channels];
+	}
+
+	matrix->in_channels = in_channels;
+	matrix->out_channels = out_channels;
+	matrix->kernel = in_channels == out_channels ? audio_dsp_get_kernel(out_channels, diagonal) : audio_dsp_mix_scalar<0>::run;
+}
+
+/* Side of a channel in the OBS speaker layouts, center channels and the LFE are not moved by balance */
+enum audio_dsp_side {
+	AUDIO_DSP_SIDE_CENTER,
+	AUDIO_DSP_SIDE_LEFT,
+	AUDIO_DSP_SIDE_RIGHT,
+	AUDIO_DSP_SIDE_LFE,
+};
+
+static audio_dsp_side audio_dsp_channel_side(uint32_t channels, uint32_t channel)
+{
+	if (channels < 2)
+		return AUDIO_DSP_SIDE_CENTER;
+	if ((channels == 3 && channel == 2) || (channels >= 5 && channel == 3))
+		return AUDIO_DSP_SIDE_LFE;
+	// FL FR, then the rear pair of 5.1 and 7.1 and the side pair of 7.1.
+	if (channel == 0 || (channels >= 6 && (channel == 4 || channel == 6)))
+		return AUDIO_DSP_SIDE_LEFT;
+	if (channel == 1 || (channels >= 6 && (channel == 5 || channel == 7)))
+		return AUDIO_DSP_SIDE_RIGHT;
+	return AUDIO_DSP_SIDE_CENTER;
+}
+
+void audio_dsp_channel_gains(float *gains, uint32_t channels, float volume, float balance)
+{
+	float left = 1.0f;
+	float right = 1.0f;
+	const float bal = (balance + 1.0f) / 2.0f;
+	if (!close_float(bal, 0.5f, EPSILON)) {
+		left = sinf((1.0f - bal) * (M_PI / 2.0f));
+		right = sinf(bal * (M_PI / 2.0f));
+	}
+	for (uint32_t channel = 0; channel < channels && channel < MAX_AUDIO_CHANNELS; channel++) {
+		const audio_dsp_side side = audio_dsp_channel_side(channels, channel);
+		gains[channel] = volume * (side == AUDIO_DSP_SIDE_LEFT ? left : (side == AUDIO_DSP_SIDE_RIGHT ? right : 1.0f));
+	}
+}
+
+bool audio_dsp_matrix_update(struct audio_dsp_matrix *matrix, uint32_t channels, float volume, bool mono, float balance,
+			     int channel_pair)
+{
+	if (channels > MAX_AUDIO_CHANNELS)
+		channels = 0;
+	mono = mono && channels > 1;
+	if (channel_pair < 0 || channel_pair * 2 > (int)channels)
+		channel_pair = 0;
+	if (matrix->channels == channels && matrix->volume == volume && matrix->balance == balance && matrix->mono == mono &&
+	    matrix->channel_pair == channel_pair && (matrix->kernel || !channels))
+		return false;
+
+	matrix->channels = channels;
+	matrix->volume = volume;
+	matrix->balance = balance;
+	matrix->mono = mono;
+	matrix->channel_pair = channel_pair;
+
+	// Coefficients of the output row by input column, built as routing, then mono, then volume and balance per output.
+	float m[MAX_AUDIO_CHANNELS][MAX_AUDIO_CHANNELS] = {{0}};
+	if (channel_pair) {
+		m[0][channel_pair * 2 - 2] = 1.0f;
+		m[1][channel_pair * 2 - 1] = 1.0f;
+	} else {
+		for (uint32_t channel = 0; channel < channels; channel++)
+			m[channel][channel] = 1.0f;
+	}
+
+	if (mono) {
+		// The average of the outputs that carry a signal goes to all of them, the LFE is left out.
+		float sum[MAX_AUDIO_CHANNELS] = {0};
+		bool live[MAX_AUDIO_CHANNELS] = {false};
+		uint32_t count = 0;
+		for (uint32_t o = 0; o < channels; o++) {
+			if (audio_dsp_channel_side(channels, o) == AUDIO_DSP_SIDE_LFE)
+				continue;
+			for (uint32_t i = 0; i < channels; i++) {
+				sum[i] += m[o][i];
+				live[o] = live[o] || m[o][i] != 0.0f;
+			}
+			if (live[o])
+				count++;
+		}
+		for (uint32_t o = 0; count && o < channels; o++) {
+			if (!live[o])
+				continue;
+			for (uint32_t i = 0; i < channels; i++)
+				m[o][i] = sum[i] / (float)count;
+		}
+	}
+
+	float gains[MAX_AUDIO_CHANNELS];
+	audio_dsp_channel_gains(gains, channels, volume, balance);
+	for (uint32_t o = 0; o < channels; o++) {
+		for (uint32_t i = 0; i < channels; i++)
+			m[o][i] *= gains[o];
+	}
+
+	float coefficients[MAX_AUDIO_CHANNELS * MAX_AUDIO_CHANNELS];
+	for (uint32_t o = 0; o < channels; o++) {
+		for (uint32_t i = 0; i < channels; i++)
+			coefficients[o * channels + i] = m[o][i];
+	}
+	audio_dsp_matrix_set(matrix, channels, channels, coefficients);
+	return true;
+}
+
+void audio_dsp_apply(const struct audio_dsp_matrix *matrix, const float *in, float *out, size_t frames)
+{
+	if (matrix->kernel)
+		matrix->kernel(matrix, in, out, frames);
+}
+
+/* Interleaving kernels, planes holds one plane of frames samples per channel. Mono is a copy, stereo SIMD unpacks
+ * the two planes into frames and 7.1 transposes blocks of 4 frames with 4 channels. */
+typedef void (*audio_dsp_interleave_func)(const uint8_t *const *planes, float *out, uint32_t channels, size_t frames);
+
+template<uint32_t Channels> struct audio_dsp_interleave_scalar {
+	static void run(const uint8_t *const *planes, float *out, uint32_t channels, size_t frames)
+	{
+		const uint32_t count = audio_dsp_channels<Channels>(channels);
+		if (count == 1) {
+			memcpy(out, planes[0], frames * sizeof(float));
+			return;
+		}
+		for (uint32_t channel = 0; channel < count; channel++) {
+			const float *plane = reinterpret_cast<const float *>(planes[channel]);
+			for (size_t frame = 0; frame < frames; frame++)
+				out[frame * count + channel] = plane[frame];
+		}
+	}
+};
+
+/* Continues a kernel from frame offset on, for the frames a SIMD loop left over */
+template<uint32_t Channels>
+static inline void audio_dsp_interleave_tail(const uint8_t *const *planes, float *out, uint32_t channels, size_t offset,
+					     size_t frames)
+{
+	const uint8_t *rest[MAX_AUDIO_CHANNELS];
+	const uint32_t count = audio_dsp_channels<Channels>(channels);
+	for (uint32_t channel = 0; channel < count; channel++)
+		rest[channel] = planes[channel] + offset * sizeof(float);
+	audio_dsp_interleave_scalar<Channels>::run(rest, out + offset * count, channels, frames - offset);
+}
+
+#ifdef AUDIO_DSP_X86
+template<uint32_t Channels> struct audio_dsp_interleave_sse2 {
+	AUDIO_DSP_TARGET("sse2")
+	static void run(const uint8_t *const *planes, float *out, uint32_t channels, size_t frames)
+	{
+		if constexpr (Channels == 2) {
+			const float *left = reinterpret_cast<const float *>(planes[0]);
+			const float *right = reinterpret_cast<const float *>(planes[1]);
+			size_t frame = 0;
+			for (; frame + 4 <= frames; frame += 4) {
+				const __m128 l = _mm_loadu_ps(left + frame);
+				const __m128 r = _mm_loadu_ps(right + frame);
+				_mm_storeu_ps(out + frame * 2, _mm_unpacklo_ps(l, r));
+				_mm_storeu_ps(out + frame * 2 + 4, _mm_unpackhi_ps(l, r));
+			}
+			audio_dsp_interleave_tail<2>(planes, out, channels, frame, frames);
+		} else if constexpr (Channels == 8) {
+			size_t frame = 0;
+			for (; frame + 4 <= frames; frame += 4) {
+				for (uint32_t half = 0; half < 8; half += 4) {
+					__m128 c0 = _mm_loadu_ps(reinterpret_cast<const float *>(planes[half]) + frame);
+					__m128 c1 = _mm_loadu_ps(reinterpret_cast<const float *>(planes[half + 1]) + frame);
+					__m128 c2 = _mm_loadu_ps(reinterpret_cast<const float *>(planes[half + 2]) + frame);
+					__m128 c3 = _mm_loadu_ps(reinterpret_cast<const float *>(planes[half + 3]) + frame);
+					_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+					float *dst = out + frame * 8 + half;
+					_mm_storeu_ps(dst, c0);
+					_mm_storeu_ps(dst + 8, c1);
+					_mm_storeu_ps(dst + 16, c2);
+					_mm_storeu_ps(dst + 24, c3);
+				}
+			}
+			audio_dsp_interleave_tail<8>(planes, out, channels, frame, frames);
+		} else {
+			audio_dsp_interleave_scalar<Channels>::run(planes, out, channels, frames);
+		}
+	}
+};
+
+/* The unpacks work within each 128 bit lane, the permutes put the frames back in order */
+template<uint32_t Channels> struct audio_dsp_interleave_avx2 {
+	AUDIO_DSP_TARGET("avx2")
+	static void run(const uint8_t *const *planes, float *out, uint32_t channels, size_t frames)
+	{
+		if constexpr (Channels == 2) {
+			const float *left = reinterpret_cast<const float *>(planes[0]);
+			const float *right = reinterpret_cast<const float *>(planes[1]);
+			size_t frame = 0;
+			for (; frame + 8 <= frames; frame += 8) {
+				const __m256 l = _mm256_loadu_ps(left + frame);
+				const __m256 r = _mm256_loadu_ps(right + frame);
+				const __m256 lo = _mm256_unpacklo_ps(l, r);
+				const __m256 hi = _mm256_unpackhi_ps(l, r);
+				_mm256_storeu_ps(out + frame * 2, _mm256_permute2f128_ps(lo, hi, 0x20));
+				_mm256_storeu_ps(out + frame * 2 + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+			}
+			audio_dsp_interleave_tail<2>(planes, out, channels, frame, frames);
+		} else {
+			audio_dsp_interleave_sse2<Channels>::run(planes, out, channels, frames);
+		}
+	}
+};
+#endif
+
+#ifdef AUDIO_DSP_NEON
+template<uint32_t Channels> struct audio_dsp_interleave_neon {
+	static void run(const uint8_t *const *planes, float *out, uint32_t channels, size_t frames)
+	{
+		if constexpr (Channels == 2) {
+			const float *left = reinterpret_cast<const float *>(planes[0]);
+			const float *right = reinterpret_cast<const float *>(planes[1]);
+			size_t frame = 0;
+			for (; frame + 4 <= frames; frame += 4) {
+				float32x4x2_t v;
+				v.val[0] = vld1q_f32(left + frame);
+				v.val[1] = vld1q_f32(right + frame);
+				vst2q_f32(out + frame * 2, v);
+			}
+			audio_dsp_interleave_tail<2>(planes, out, channels, frame, frames);
+		} else if constexpr (Channels == 8) {
+			// Two interleaving stores of 4 channels, each writes every other half frame.
+			size_t frame = 0;
+			for (; frame + 4 <= frames; frame += 4) {
+				for (uint32_t half = 0; half < 8; half += 4) {
+					float32x4x4_t v;
+					for (uint32_t c = 0; c < 4; c++)
+						v.val[c] = vld1q_f32(reinterpret_cast<const float *>(planes[half + c]) + frame);
+					float block[16];
+					vst4q_f32(block, v);
+					for (uint32_t f = 0; f < 4; f++)
+						vst1q_f32(out + (frame + f) * 8 + half, vld1q_f32(block + f * 4));
+				}
+			}
+			audio_dsp_interleave_tail<8>(planes, out, channels, frame, frames);
+		} else {
+			audio_dsp_interleave_scalar<Channels>::run(planes, out, channels, frames);
+		}
+	}
+};
+#endif
+
+static audio_dsp_interleave_func audio_dsp_get_interleave(uint32_t channels)
+{
+	switch (audio_dsp_gain_isa) {
+#ifdef AUDIO_DSP_X86
+	case AUDIO_DSP_ISA_AVX2:
+		return audio_dsp_specialize<audio_dsp_interleave_avx2>(channels);
+	case AUDIO_DSP_ISA_SSE2:
+		return audio_dsp_specialize<audio_dsp_interleave_sse2>(channels);
+#endif
+#ifdef AUDIO_DSP_NEON
+	case AUDIO_DSP_ISA_NEON:
+		return audio_dsp_specialize<audio_dsp_interleave_neon>(channels);
+#endif
+	default:
+		return audio_dsp_specialize<audio_dsp_interleave_scalar>(channels);
+	}
+}
+
+/* Polyphase windowed sinc resampler. The rate ratio is reduced to L/M, output frame n sits at n * M / L input frames
+ * and is the dot product of taps input frames with phase (n * M) % L of a Kaiser windowed sinc. History is kept
+ * planar per channel, so every dot product runs over contiguous samples and coefficients. */
+struct audio_dsp_sinc_preset {
+	uint32_t taps;
+	/* stopband attenuation in dB, the Kaiser beta and transition width follow from it */
+	double attenuation;
+};
+
+/* Taps at the lower rate, downsampling stretches the filter by the ratio */
+static const audio_dsp_sinc_preset audio_dsp_sinc_presets[] = {
+	{24, 70.0},
+	{48, 90.0},
+	{128, 120.0},
+};
+
+#define AUDIO_DSP_SINC_MAX_PHASES 1024
+#define AUDIO_DSP_SINC_MAX_TAPS 1024
+
+typedef float (*audio_dsp_dot_func)(const float *a, const float *b, uint32_t count);
+
+/* count is always a multiple of 8. Every kernel keeps 8 partial sums, one per tap modulo 8, and adds them up as
+ * ((s0 + s4) + (s2 + s6)) + ((s1 + s5) + (s3 + s7)), so all of them give the same result. */
+static float audio_dsp_dot_scalar(const float *a, const float *b, uint32_t count)
+{
+	float sum[8] = {0};
+	for (uint32_t i = 0; i < count; i += 8) {
+		for (uint32_t k = 0; k < 8; k++)
+			sum[k] += a[i + k] * b[i + k];
+	}
+	float half[4];
+	for (uint32_t k = 0; k < 4; k++)
+		half[k] = sum[k] + sum[k + 4];
+	return (half[0] + half[2]) + (half[1] + half[3]);
+}
+
+#ifdef AUDIO_DSP_X86
+AUDIO_DSP_TARGET("sse2")
+static float audio_dsp_dot_sse2(const float *a, const float *b, uint32_t count)
+{
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	for (uint32_t i = 0; i < count; i += 8) {
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	__m128 sum = _mm_add_ps(sum0, sum1);
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_cvtss_f32(sum);
+}
+
+// A single accumulator, a second one would change the order of the sums.
+AUDIO_DSP_TARGET("avx2")
+static float audio_dsp_dot_avx2(const float *a, const float *b, uint32_t count)
+{
+	__m256 sum = _mm256_setzero_ps();
+	for (uint32_t i = 0; i < count; i += 8)
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+	__m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+	half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+	half = _mm_add_ss(half, _mm_shuffle_ps(half, half, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_cvtss_f32(half);
+}
+#endif
+
+#ifdef AUDIO_DSP_NEON
+// Multiply and add apart, vmlaq_f32 may be fused into a single rounding.
+static float audio_dsp_dot_neon(const float *a, const float *b, uint32_t count)
+{
+	float32x4_t sum0 = vdupq_n_f32(0.0f);
+	float32x4_t sum1 = vdupq_n_f32(0.0f);
+	for (uint32_t i = 0; i < count; i += 8) {
+		sum0 = vaddq_f32(sum0, vmulq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+		sum1 = vaddq_f32(sum1, vmulq_f32(vld1q_f32(a + i + 4), vld1q_f32(b + i + 4)));
+	}
+	const float32x4_t sum = vaddq_f32(sum0, sum1);
+	const float32x2_t half = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+	return vget_lane_f32(half, 0) + vget_lane_f32(half, 1);
+}
+#endif
+
+static audio_dsp_dot_func audio_dsp_get_dot(void)
+{
+	switch (audio_dsp_gain_isa) {
+#ifdef AUDIO_DSP_X86
+	case AUDIO_DSP_ISA_AVX2:
+		return audio_dsp_dot_avx2;
+	case AUDIO_DSP_ISA_SSE2:
+		return audio_dsp_dot_sse2;
+#endif
+#ifdef AUDIO_DSP_NEON
+	case AUDIO_DSP_ISA_NEON:
+		return audio_dsp_dot_neon;
+#endif
+	default:
+		return audio_dsp_dot_scalar;
+	}
+}
+
+/* Modified Bessel function of the first kind, order 0, for the Kaiser window */
+static double audio_dsp_bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	for (int k = 1; k < 64 && term > sum * 1e-12; k++) {
+		const double half = x / (2.0 * k);
+		term *= half * half;
+		sum += term;
+	}
+	return sum;
+}
+
+struct audio_dsp_sinc {
+	uint32_t up;
+	uint32_t down;
+	uint32_t taps;
+	uint32_t channels;
+	audio_dsp_dot_func dot;
+	/* taps coefficients for each of the up phases */
+	float *coefficients;
+
+	/* planar history of every channel, window is the first frame of the next dot product */
+	float *history;
+	size_t capacity;
+	size_t frames;
+	size_t window;
+	uint32_t phase;
+
+	float *output;
+	size_t output_frames;
+};
+
+static uint32_t audio_dsp_gcd(uint32_t a, uint32_t b)
+{
+	while (b) {
+		const uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+static struct audio_dsp_sinc *audio_dsp_sinc_create(uint32_t src_rate, uint32_t dst_rate, uint32_t channels, int quality)
+{
+	if (quality < AUDIO_DSP_RESAMPLER_FAST || quality > AUDIO_DSP_RESAMPLER_MASTERING || !src_rate || !dst_rate ||
+	    !channels || channels > MAX_AUDIO_CHANNELS)
+		return nullptr;
+
+	const uint32_t gcd = audio_dsp_gcd(src_rate, dst_rate);
+	const uint32_t up = dst_rate / gcd;
+	const uint32_t down = src_rate / gcd;
+	const audio_dsp_sinc_preset &preset = audio_dsp_sinc_presets[quality - AUDIO_DSP_RESAMPLER_FAST];
+	// Downsampling lowers the cutoff, a longer filter keeps the same transition band at the output rate.
+	uint32_t taps = preset.taps;
+	if (down > up)
+		taps = (uint32_t)((uint64_t)taps * down / up);
+	taps = (taps + 7) & ~7u;
+	if (up > AUDIO_DSP_SINC_MAX_PHASES || taps > AUDIO_DSP_SINC_MAX_TAPS)
+		return nullptr;
+
+	auto *sinc = static_cast<struct audio_dsp_sinc *>(bzalloc(sizeof(struct audio_dsp_sinc)));
+	sinc->up = up;
+	sinc->down = down;
+	sinc->taps = taps;
+	sinc->channels = channels;
+	sinc->dot = audio_dsp_get_dot();
+	sinc->coefficients = static_cast<float *>(bmalloc((size_t)up * taps * sizeof(float)));
+
+	// Kaiser design, the transition band ends at the lower Nyquist so nothing above it folds back.
+	const double beta = 0.1102 * (preset.attenuation - 8.7);
+	const double transition = (preset.attenuation - 8.0) / (2.285 * (preset.taps - 1) * M_PI);
+	const double cutoff = (1.0 - transition / 2.0) * (up < down ? (double)up / down : 1.0);
+	const double half = taps / 2.0;
+	for (uint32_t phase = 0; phase < up; phase++) {
+		float *coefficients = sinc->coefficients + (size_t)phase * taps;
+		double sum = 0.0;
+		for (uint32_t k = 0; k < taps; k++) {
+			// Distance of tap k from the output position, which lies phase / up past the middle of the window.
+			const double x = (double)k - (half - 1.0) - (double)phase / up;
+			const double r = x / half;
+			const double window = r <= -1.0 || r >= 1.0 ? 0.0 : audio_dsp_bessel_i0(beta * sqrt(1.0 - r * r));
+			const double arg = M_PI * cutoff * x;
+			const double value = (fabs(arg) < 1e-9 ? 1.0 : sin(arg) / arg) * window;
+			coefficients[k] = (float)value;
+			sum += value;
+		}
+		// Every phase passes DC at unity gain, no ripple at the phase rate.
+		for (uint32_t k = 0; k < taps; k++)
+			coefficients[k] = (float)(coefficients[k] / sum);
+	}
+
+	// Half a window of silence in front, the first output then lines up with the first input.
+	sinc->capacity = (size_t)taps * 2;
+	sinc->history = static_cast<float *>(bzalloc(sinc->capacity * channels * sizeof(float)));
+	sinc->frames = taps / 2 - 1;
+	return sinc;
+}
+
+static void audio_dsp_sinc_destroy(struct audio_dsp_sinc *sinc)
+{
+	if (!sinc)
+		return;
+	bfree(sinc->coefficients);
+	bfree(sinc->history);
+	bfree(sinc->output);
+	bfree(sinc);
+}
+
+/* Delay of the filter, the half window it needs to see past each output */
+static uint64_t audio_dsp_sinc_latency_ns(const struct audio_dsp_sinc *sinc, uint32_t src_rate)
+{
+	return (uint64_t)(sinc->taps / 2) * 1000000000ULL / src_rate;
+}
+
+static void audio_dsp_sinc_resample(struct audio_dsp_sinc *sinc, const uint8_t *const input[], uint32_t in_frames,
+				    float **output, uint32_t *out_frames)
+{
+	const size_t frames = sinc->frames + in_frames;
+	if (sinc->capacity < frames) {
+		// Channels sit capacity frames apart, moving them to the new spacing happens back to front.
+		const size_t capacity = frames + frames / 2;
+		sinc->history = static_cast<float *>(brealloc(sinc->history, capacity * sinc->channels * sizeof(float)));
+		for (uint32_t channel = sinc->channels; channel-- > 1;)
+			memmove(sinc->history + channel * capacity, sinc->history + channel * sinc->capacity,
+				sinc->frames * sizeof(float));
+		sinc->capacity = capacity;
+	}
+	for (uint32_t channel = 0; channel < sinc->channels; channel++)
+		memcpy(sinc->history + channel * sinc->capacity + sinc->frames, input[channel], in_frames * sizeof(float));
+	sinc->frames = frames;
+
+	const size_t most = ((size_t)in_frames * sinc->up) / sinc->down + 2;
+	if (sinc->output_frames < most) {
+		sinc->output = static_cast<float *>(brealloc(sinc->output, most * sinc->channels * sizeof(float)));
+		sinc->output_frames = most;
+	}
+
+	size_t produced = 0;
+	while (sinc->window + sinc->taps <= sinc->frames && produced < most) {
+		const float *coefficients = sinc->coefficients + (size_t)sinc->phase * sinc->taps;
+		float *out = sinc->output + produced * sinc->channels;
+		for (uint32_t channel = 0; channel < sinc->channels; channel++)
+			out[channel] = sinc->dot(sinc->history + channel * sinc->capacity + sinc->window, coefficients, sinc->taps);
+		produced++;
+		sinc->phase += sinc->down;
+		sinc->window += sinc->phase / sinc->up;
+		sinc->phase %= sinc->up;
+	}
+
+	// Keep what the next windows still need at the front.
+	const size_t keep = sinc->window < sinc->frames ? sinc->frames - sinc->window : 0;
+	const size_t consumed = sinc->frames - keep;
+	if (consumed) {
+		for (uint32_t channel = 0; channel < sinc->channels; channel++) {
+			float *history = sinc->history + channel * sinc->capacity;
+			memmove(history, history + consumed, keep * sizeof(float));
+		}
+	}
+	sinc->window -= consumed;
+	sinc->frames = keep;
+
+	*output = sinc->output;
+	*out_frames = (uint32_t)produced;
+}
+
+/* A conversion of one stream to one output spec. Monitors that pass the same stream and spec share it, the first
+ * monitor fed a block converts it and the others get the same read only result. Monitors of one stream are fed on
+ * the same thread, so only the list and the reference counts need the lock. */
+struct audio_dsp_resampler {
+	struct audio_dsp_resampler *next;
+	long refs;
+	const void *stream;
+	struct resample_info dst;
+	struct resample_info src;
+
+	int quality;
+	/* with the same rate and layout the planes are only interleaved, a different layout always takes libobs */
+	audio_resampler_t *resampler;
+	struct audio_dsp_sinc *sinc;
+	audio_dsp_interleave_func interleave;
+	uint32_t channels;
+	float *buffer;
+	uint32_t buffer_frames;
+
+	/* the block converted last and its result, a failed conversion is not retried for the same block */
+	bool seen;
+	bool converted;
+	const uint8_t *input;
+	uint64_t timestamp;
+	uint32_t in_frames;
+	uint8_t *output[MAX_AV_PLANES];
+	uint32_t out_frames;
+	uint64_t ts_offset;
+};
+
+static pthread_mutex_t audio_dsp_resamplers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct audio_dsp_resampler *audio_dsp_resamplers = nullptr;
+
+static inline bool audio_dsp_same_info(const struct resample_info *a, const struct resample_info *b)
+{
+	return a->samples_per_sec == b->samples_per_sec && a->format == b->format && a->speakers == b->speakers;
+}
+
+struct audio_dsp_resampler *audio_dsp_resampler_create(const struct resample_info *dst, const struct resample_info *src,
+							int quality, const void *stream)
+{
+	pthread_mutex_lock(&audio_dsp_resamplers_mutex);
+	for (struct audio_dsp_resampler *rs = audio_dsp_resamplers; stream && rs; rs = rs->next) {
+		if (rs->stream == stream && rs->quality == quality && audio_dsp_same_info(&rs->dst, dst) &&
+		    audio_dsp_same_info(&rs->src, src)) {
+			rs->refs++;
+			pthread_mutex_unlock(&audio_dsp_resamplers_mutex);
+			return rs;
+		}
+	}
+
+	const uint32_t channels = get_audio_channels(src->speakers);
+	const bool same_layout = src->format == AUDIO_FORMAT_FLOAT_PLANAR && dst->format == AUDIO_FORMAT_FLOAT &&
+				 src->speakers == dst->speakers && channels && channels <= MAX_AUDIO_CHANNELS;
+	const bool bypass = same_layout && src->samples_per_sec == dst->samples_per_sec;
+
+	// The polyphase resampler only changes the rate, it falls back to libobs for ratios with too many phases.
+	struct audio_dsp_sinc *sinc = nullptr;
+	if (same_layout && !bypass && quality != AUDIO_DSP_RESAMPLER_LIBOBS)
+		sinc = audio_dsp_sinc_create(src->samples_per_sec, dst->samples_per_sec, channels, quality);
+
+	audio_resampler_t *resampler = nullptr;
+	if (!bypass && !sinc) {
+		resampler = audio_resampler_create(dst, src);
+		if (!resampler) {
+			pthread_mutex_unlock(&audio_dsp_resamplers_mutex);
+			return nullptr;
+		}
+	}
+
+	auto *rs = static_cast<struct audio_dsp_resampler *>(bzalloc(sizeof(struct audio_dsp_resampler)));
+	rs->refs = 1;
+	rs->stream = stream;
+	rs->dst = *dst;
+	rs->src = *src;
+	rs->quality = quality;
+	rs->resampler = resampler;
+	rs->sinc = sinc;
+	if (bypass) {
+		rs->interleave = audio_dsp_get_interleave(channels);
+		rs->channels = channels;
+	}
+	// Without a stream nothing can share it, it stays off the list.
+	if (stream) {
+		rs->next = audio_dsp_resamplers;
+		audio_dsp_resamplers = rs;
+	}
+	pthread_mutex_unlock(&audio_dsp_resamplers_mutex);
+	return rs;
+}
+
+void audio_dsp_resampler_destroy(struct audio_dsp_resampler *resampler)
+{
+	if (!resampler)
+		return;
+	pthread_mutex_lock(&audio_dsp_resamplers_mutex);
+	if (--resampler->refs > 0) {
+		pthread_mutex_unlock(&audio_dsp_resamplers_mutex);
+		return;
+	}
+	for (struct audio_dsp_resampler **rs = &audio_dsp_resamplers; *rs; rs = &(*rs)->next) {
+		if (*rs == resampler) {
+			*rs = resampler->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&audio_dsp_resamplers_mutex);
+
+	audio_resampler_destroy(resampler->resampler);
+	audio_dsp_sinc_destroy(resampler->sinc);
+	bfree(resampler->buffer);
+	bfree(resampler);
+}
+
+static bool audio_dsp_resampler_convert(struct audio_dsp_resampler *resampler, const uint8_t *const input[], uint32_t in_frames)
+{
+	if (resampler->resampler)
+		return audio_resampler_resample(resampler->resampler, resampler->output, &resampler->out_frames,
+						&resampler->ts_offset, input, in_frames);
+	if (resampler->sinc) {
+		float *output;
+		audio_dsp_sinc_resample(resampler->sinc, input, in_frames, &output, &resampler->out_frames);
+		resampler->output[0] = reinterpret_cast<uint8_t *>(output);
+		resampler->ts_offset = audio_dsp_sinc_latency_ns(resampler->sinc, resampler->src.samples_per_sec);
+		return true;
+	}
+
+	if (resampler->buffer_frames < in_frames) {
+		const size_t size = (size_t)in_frames * resampler->channels * sizeof(float);
+		resampler->buffer = static_cast<float *>(brealloc(resampler->buffer, size));
+		resampler->buffer_frames = in_frames;
+	}
+	resampler->interleave(input, resampler->buffer, resampler->channels, in_frames);
+	resampler->output[0] = reinterpret_cast<uint8_t *>(resampler->buffer);
+	resampler->out_frames = in_frames;
+	resampler->ts_offset = 0;
+	return true;
+}
+
+uint64_t audio_dsp_resampler_get_latency_ns(const struct audio_dsp_resampler *resampler)
+{
+	if (!resampler)
+		return 0;
+	if (resampler->sinc)
+		return audio_dsp_sinc_latency_ns(resampler->sinc, resampler->src.samples_per_sec);
+	// libswresample reports what it holds back with every block.
+	return resampler->converted ? resampler->ts_offset : 0;
+}
+
+bool audio_dsp_resampler_resample(struct audio_dsp_resampler *resampler, const uint8_t *output[], uint32_t *out_frames,
+				  uint64_t *ts_offset, const uint8_t *const input[], uint32_t in_frames, uint64_t timestamp)
+{
+	const bool seen = resampler->seen && resampler->input == input[0] && resampler->timestamp == timestamp &&
+			  resampler->in_frames == in_frames;
+	if (!seen) {
+		resampler->seen = true;
+		resampler->converted = audio_dsp_resampler_convert(resampler, input, in_frames);
+		resampler->input = input[0];
+		resampler->timestamp = timestamp;
+		resampler->in_frames = in_frames;
+	}
+	if (!resampler->converted)
+		return false;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		output[i] = resampler->output[i];
+	*out_frames = resampler->out_frames;
+	*ts_offset = resampler->ts_offset;
+	return true;
+}
+
+void audio_dsp_dither_init(struct audio_dsp_dither *dither, uint32_t seed)
+{
+	// xorshift never leaves 0, so every lane gets a different odd seed.
+	for (size_t i = 0; i < 4; i++) {
+		seed = seed * 1664525u + 1013904223u;
+		dither->state[i] = seed | 1;
+	}
+}
+
+static inline uint32_t audio_dsp_xorshift(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+/* Difference of two uniform values in 0..1, triangular in -1..1 */
+static inline float audio_dsp_tpdf(uint32_t *state)
+{
+	const float a = (float)(audio_dsp_xorshift(state) >> 8) * (1.0f / 16777216.0f);
+	const float b = (float)(audio_dsp_xorshift(state) >> 8) * (1.0f / 16777216.0f);
+	return a - b;
+}
+
+/* Storage type, scale, offset and limits of each integer format. Samples are clamped in the scaled domain so the
+ * conversion can never overflow, the s32 maximum is the largest float below 2^31. */
+template<enum audio_format Format> struct audio_dsp_format;
+
+template<> struct audio_dsp_format<AUDIO_FORMAT_U8BIT> {
+	using type = uint8_t;
+	static constexpr float scale = 127.0f;
+	static constexpr float offset = 128.0f;
+	static constexpr float min = 0.0f;
+	static constexpr float max = 255.0f;
+};
+
+template<> struct audio_dsp_format<AUDIO_FORMAT_16BIT> {
+	using type = int16_t;
+	static constexpr float scale = 32767.0f;
+	static constexpr float offset = 0.0f;
+	static constexpr float min = -32768.0f;
+	static constexpr float max = 32767.0f;
+};
+
+template<> struct audio_dsp_format<AUDIO_FORMAT_32BIT> {
+	using type = int32_t;
+	static constexpr float scale = 2147483647.0f;
+	static constexpr float offset = 0.0f;
+	static constexpr float min = -2147483648.0f;
+	static constexpr float max = 2147483520.0f;
+};
+
+template<enum audio_format Format> static inline int32_t audio_dsp_quantize(float sample, uint32_t *dither)
+{
+	using format = audio_dsp_format<Format>;
+	float v = sample * format::scale + format::offset;
+	if (dither)
+		v += audio_dsp_tpdf(dither);
+	v = v < format::min ? format::min : (v > format::max ? format::max : v);
+	return (int32_t)lrintf(v);
+}
+
+template<enum audio_format Format> struct audio_dsp_convert_scalar {
+	static void run(const float *in, uint8_t *out, size_t samples, uint32_t *dither)
+	{
+		using type = typename audio_dsp_format<Format>::type;
+		for (size_t i = 0; i < samples; i++)
+			reinterpret_cast<type *>(out)[i] = (type)audio_dsp_quantize<Format>(in[i], dither);
+	}
+};
+
+#ifdef AUDIO_DSP_X86
+AUDIO_DSP_TARGET("sse2")
+static inline __m128 audio_dsp_uniform_sse2(__m128i *state)
+{
+	__m128i x = *state;
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+	*state = x;
+	return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(x, 8)), _mm_set1_ps(1.0f / 16777216.0f));
+}
+
+/* Four samples scaled, dithered, clamped and rounded to int32, state is NULL without dither */
+template<enum audio_format Format>
+AUDIO_DSP_TARGET("sse2")
+static inline __m128i audio_dsp_quantize_sse2(const float *in, __m128i *state)
+{
+	using format = audio_dsp_format<Format>;
+	__m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in), _mm_set1_ps(format::scale)), _mm_set1_ps(format::offset));
+	if (state) {
+		const __m128 a = audio_dsp_uniform_sse2(state);
+		v = _mm_add_ps(v, _mm_sub_ps(a, audio_dsp_uniform_sse2(state)));
+	}
+	v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(format::min)), _mm_set1_ps(format::max));
+	return _mm_cvtps_epi32(v);
+}
+
+/* Blocks of 8 samples, packed with saturation to the width of the format */
+template<enum audio_format Format> struct audio_dsp_convert_sse2 {
+	AUDIO_DSP_TARGET("sse2")
+	static void run(const float *in, uint8_t *out, size_t samples, uint32_t *dither)
+	{
+		using type = typename audio_dsp_format<Format>::type;
+		__m128i state = dither ? _mm_loadu_si128((const __m128i *)dither) : _mm_setzero_si128();
+		__m128i *noise = dither ? &state : nullptr;
+		size_t i = 0;
+		for (; i + 8 <= samples; i += 8) {
+			const __m128i lo = audio_dsp_quantize_sse2<Format>(in + i, noise);
+			const __m128i hi = audio_dsp_quantize_sse2<Format>(in + i + 4, noise);
+			uint8_t *dst = out + i * sizeof(type);
+			if constexpr (Format == AUDIO_FORMAT_U8BIT) {
+				const __m128i words = _mm_packs_epi32(lo, hi);
+				_mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(words, words));
+			} else if constexpr (Format == AUDIO_FORMAT_16BIT) {
+				_mm_storeu_si128((__m128i *)dst, _mm_packs_epi32(lo, hi));
+			} else {
+				_mm_storeu_si128((__m128i *)dst, lo);
+				_mm_storeu_si128((__m128i *)(dst + 16), hi);
+			}
+		}
+		if (dither)
+			_mm_storeu_si128((__m128i *)dither, state);
+		audio_dsp_convert_scalar<Format>::run(in + i, out + i * sizeof(type), samples - i, dither);
+	}
+};
+#endif
+
+#ifdef AUDIO_DSP_NEON
+static inline float32x4_t audio_dsp_uniform_neon(uint32x4_t *state)
+{
+	uint32x4_t x = *state;
+	x = veorq_u32(x, vshlq_n_u32(x, 13));
+	x = veorq_u32(x, vshrq_n_u32(x, 17));
+	x = veorq_u32(x, vshlq_n_u32(x, 5));
+	*state = x;
+	return vmulq_n_f32(vcvtq_f32_u32(vshrq_n_u32(x, 8)), 1.0f / 16777216.0f);
+}
+
+template<enum audio_format Format> static inline int32x4_t audio_dsp_quantize_neon(const float *in, uint32x4_t *state)
+{
+	using format = audio_dsp_format<Format>;
+	float32x4_t v = vaddq_f32(vmulq_n_f32(vld1q_f32(in), format::scale), vdupq_n_f32(format::offset));
+	if (state) {
+		const float32x4_t a = audio_dsp_uniform_neon(state);
+		v = vaddq_f32(v, vsubq_f32(a, audio_dsp_uniform_neon(state)));
+	}
+	v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(format::min)), vdupq_n_f32(format::max));
+	return vcvtnq_s32_f32(v);
+}
+
+template<enum audio_format Format> struct audio_dsp_convert_neon {
+	static void run(const float *in, uint8_t *out, size_t samples, uint32_t *dither)
+	{
+		using type = typename audio_dsp_format<Format>::type;
+		uint32x4_t state = dither ? vld1q_u32(dither) : vdupq_n_u32(0);
+		uint32x4_t *noise = dither ? &state : nullptr;
+		size_t i = 0;
+		for (; i + 8 <= samples; i += 8) {
+			const int32x4_t lo = audio_dsp_quantize_neon<Format>(in + i, noise);
+			const int32x4_t hi = audio_dsp_quantize_neon<Format>(in + i + 4, noise);
+			uint8_t *dst = out + i * sizeof(type);
+			if constexpr (Format == AUDIO_FORMAT_U8BIT) {
+				vst1_u8(dst, vqmovun_s16(vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi))));
+			} else if constexpr (Format == AUDIO_FORMAT_16BIT) {
+				vst1q_s16((int16_t *)dst, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+			} else {
+				vst1q_s32((int32_t *)dst, lo);
+				vst1q_s32((int32_t *)dst + 4, hi);
+			}
+		}
+		if (dither)
+			vst1q_u32(dither, state);
+		audio_dsp_convert_scalar<Format>::run(in + i, out + i * sizeof(type), samples - i, dither);
+	}
+};
+#endif
+
+/* Wraps a kernel to the exported signature, the dither state is passed on as its lanes */
+template<template<enum audio_format> class Kernel, enum audio_format Format>
+static void audio_dsp_convert(const float *in, uint8_t *out, size_t samples, struct audio_dsp_dither *dither)
+{
+	Kernel<Format>::run(in, out, samples, dither ? dither->state : nullptr);
+}
+
+static void audio_dsp_convert_float(const float *in, uint8_t *out, size_t samples, struct audio_dsp_dither *dither)
+{
+	UNUSED_PARAMETER(dither);
+	memcpy(out, in, samples * sizeof(float));
+}
+
+template<template<enum audio_format> class Kernel>
+static audio_dsp_convert_func audio_dsp_specialize_convert(enum audio_format format)
+{
+	switch (format) {
+	case AUDIO_FORMAT_U8BIT:
+		return audio_dsp_convert<Kernel, AUDIO_FORMAT_U8BIT>;
+	case AUDIO_FORMAT_16BIT:
+		return audio_dsp_convert<Kernel, AUDIO_FORMAT_16BIT>;
+	case AUDIO_FORMAT_32BIT:
+		return audio_dsp_convert<Kernel, AUDIO_FORMAT_32BIT>;
+	case AUDIO_FORMAT_FLOAT:
+		return audio_dsp_convert_float;
+	default:
+		return nullptr;
+	}
+}
+
+audio_dsp_convert_func audio_dsp_get_convert(enum audio_format format)
+{
+	switch (audio_dsp_convert_isa) {
+#ifdef AUDIO_DSP_X86
+	case AUDIO_DSP_ISA_SSE2:
+		return audio_dsp_specialize_convert<audio_dsp_convert_sse2>(format);
+#endif
+#ifdef AUDIO_DSP_NEON
+	case AUDIO_DSP_ISA_NEON:
+		return audio_dsp_specialize_convert<audio_dsp_convert_neon>(format);
+#endif
+	default:
+		return audio_dsp_specialize_convert<audio_dsp_convert_scalar>(format);
+	}
+}
+
+/* Normalized sinc for the 4 points between the 4 samples of the window at x -1.5, -0.5, 0.5 and 1.5, the oversampled
+ * points are at x -0.3, -0.1, 0.1 and 0.3. Row k holds the weight of window sample k in every point. */
+static const float audio_dsp_peak_weights[4][4] = {
+	{-0.103943f, -0.189207f, -0.216236f, -0.155915f},
+	{0.233872f, 0.504551f, 0.756827f, 0.935489f},
+	{0.935489f, 0.756827f, 0.504551f, 0.233872f},
+	{-0.155915f, -0.216236f, -0.189207f, -0.103943f},
+};
+
+typedef float (*audio_dsp_peak_func)(const float *samples, size_t frames, const float *history);
+
+/* Only whole groups of 4 samples are oversampled, OBS always sends blocks of 1024 */
+static float audio_dsp_true_peak_scalar(const float *samples, size_t frames, const float *history)
+{
+	float window[4];
+	float peak = 0.0f;
+	for (size_t k = 0; k < 4; k++) {
+		window[k] = history[k];
+		peak = fmaxf(peak, fabsf(history[k]));
+	}
+	const size_t whole = frames & ~(size_t)3;
+	for (size_t i = 0; i < whole; i++) {
+		peak = fmaxf(peak, fabsf(samples[i]));
+		window[0] = window[1];
+		window[1] = window[2];
+		window[2] = window[3];
+		window[3] = samples[i];
+		for (size_t point = 0; point < 4; point++) {
+			float sample = 0.0f;
+			for (size_t k = 0; k < 4; k++)
+				sample += window[k] * audio_dsp_peak_weights[k][point];
+			peak = fmaxf(peak, fabsf(sample));
+		}
+	}
+	return peak;
+}
+
+#ifdef AUDIO_DSP_X86
+/* The 4 points of a window are one vector, every window sample broadcast times its row of weights */
+AUDIO_DSP_TARGET("sse2")
+static float audio_dsp_true_peak_sse2(const float *samples, size_t frames, const float *history)
+{
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128 w0 = _mm_loadu_ps(audio_dsp_peak_weights[0]);
+	const __m128 w1 = _mm_loadu_ps(audio_dsp_peak_weights[1]);
+	const __m128 w2 = _mm_loadu_ps(audio_dsp_peak_weights[2]);
+	const __m128 w3 = _mm_loadu_ps(audio_dsp_peak_weights[3]);
+	const __m128 previous = _mm_loadu_ps(history);
+	__m128 peak = _mm_andnot_ps(sign, previous);
+	__m128 window = previous;
+	for (size_t i = 0; i + 3 < frames; i += 4) {
+		const __m128 next = _mm_loadu_ps(samples + i);
+		peak = _mm_max_ps(peak, _mm_andnot_ps(sign, next));
+		// Windows ending on each of the 4 new samples, formed from the previous window and next.
+		const __m128 windows[4] = {
+			_mm_shuffle_ps(window, _mm_shuffle_ps(window, next, _MM_SHUFFLE(0, 0, 3, 3)), _MM_SHUFFLE(2, 1, 2, 1)),
+			_mm_shuffle_ps(window, next, _MM_SHUFFLE(1, 0, 3, 2)),
+			_mm_shuffle_ps(_mm_shuffle_ps(window, next, _MM_SHUFFLE(0, 0, 3, 3)), next, _MM_SHUFFLE(2, 1, 2, 0)),
+			next,
+		};
+		for (size_t k = 0; k < 4; k++) {
+			const __m128 w = windows[k];
+			__m128 points = _mm_mul_ps(_mm_shuffle_ps(w, w, _MM_SHUFFLE(0, 0, 0, 0)), w0);
+			points = _mm_add_ps(points, _mm_mul_ps(_mm_shuffle_ps(w, w, _MM_SHUFFLE(1, 1, 1, 1)), w1));
+			points = _mm_add_ps(points, _mm_mul_ps(_mm_shuffle_ps(w, w, _MM_SHUFFLE(2, 2, 2, 2)), w2));
+			points = _mm_add_ps(points, _mm_mul_ps(_mm_shuffle_ps(w, w, _MM_SHUFFLE(3, 3, 3, 3)), w3));
+			peak = _mm_max_ps(peak, _mm_andnot_ps(sign, points));
+		}
+		window = next;
+	}
+	peak = _mm_max_ps(peak, _mm_movehl_ps(peak, peak));
+	peak = _mm_max_ss(peak, _mm_shuffle_ps(peak, peak, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_cvtss_f32(peak);
+}
+#endif
+
+#ifdef AUDIO_DSP_NEON
+static float audio_dsp_true_peak_neon(const float *samples, size_t frames, const float *history)
+{
+	const float32x4_t w0 = vld1q_f32(audio_dsp_peak_weights[0]);
+	const float32x4_t w1 = vld1q_f32(audio_dsp_peak_weights[1]);
+	const float32x4_t w2 = vld1q_f32(audio_dsp_peak_weights[2]);
+	const float32x4_t w3 = vld1q_f32(audio_dsp_peak_weights[3]);
+	const float32x4_t previous = vld1q_f32(history);
+	float32x4_t peak = vabsq_f32(previous);
+	float32x4_t window = previous;
+	for (size_t i = 0; i + 3 < frames; i += 4) {
+		const float32x4_t next = vld1q_f32(samples + i);
+		peak = vmaxq_f32(peak, vabsq_f32(next));
+		const float32x4_t windows[4] = {vextq_f32(window, next, 1), vextq_f32(window, next, 2), vextq_f32(window, next, 3),
+						next};
+		for (size_t k = 0; k < 4; k++) {
+			float32x4_t points = vmulq_laneq_f32(w0, windows[k], 0);
+			points = vmlaq_laneq_f32(points, w1, windows[k], 1);
+			points = vmlaq_laneq_f32(points, w2, windows[k], 2);
+			points = vmlaq_laneq_f32(points, w3, windows[k], 3);
+			peak = vmaxq_f32(peak, vabsq_f32(points));
+		}
+		window = next;
+	}
+	return vmaxvq_f32(peak);
+}
+#endif
+
+float audio_dsp_true_peak(const float *samples, size_t frames, float history[4])
+{
+	audio_dsp_peak_func kernel = audio_dsp_true_peak_scalar;
+#ifdef AUDIO_DSP_X86
+	if (audio_dsp_gain_isa != AUDIO_DSP_ISA_SCALAR)
+		kernel = audio_dsp_true_peak_sse2;
+#endif
+#ifdef AUDIO_DSP_NEON
+	if (audio_dsp_gain_isa == AUDIO_DSP_ISA_NEON)
+		kernel = audio_dsp_true_peak_neon;
+#endif
+	const float peak = kernel(samples, frames, history);
+
+	if (frames >= 4) {
+		memcpy(history, samples + frames - 4, 4 * sizeof(float));
+	} else {
+		memmove(history, history + frames, (4 - frames) * sizeof(float));
+		memcpy(history + 4 - frames, samples, frames * sizeof(float));
+	}
+	return peak;
+}
+
+float audio_dsp_magnitude(const float *samples, size_t frames)
+{
+	if (!frames)
+		return 0.0f;
+	float sum = 0.0f;
+	for (size_t i = 0; i < frames; i++)
+		sum += samples[i] * samples[i];
+	return sqrtf(sum / (float)frames);
+}
+
+/* The EQ and the true peak of the limiter run across channels, the channels of a frame are the lanes of a vector and
+ * groups of 4 channels go through the whole block one after the other. Bands are transposed direct form II biquads,
+ * the true peak uses the weights of the meter on the last 4 samples of every channel. peaks is NULL without limiter. */
+template<uint32_t Channels> struct audio_dsp_eq_limiter_scalar {
+	static void run(struct audio_dsp_eq_limiter *eq_limiter, float *samples, size_t frames, float *peaks)
+	{
+		const uint32_t count = audio_dsp_channels<Channels>(eq_limiter->channels);
+		const uint32_t bands = eq_limiter->bands;
+		for (size_t frame = 0; frame < frames; frame++) {
+			float *x = samples + frame * count;
+			float peak = 0.0f;
+			for (uint32_t c = 0; c < count; c++) {
+				float sample = x[c];
+				for (uint32_t b = 0; b < bands; b++) {
+					const float *k = eq_limiter->coefficients[b];
+					const float y = k[0] * sample + eq_limiter->state[b][0][c];
+					eq_limiter->state[b][0][c] = k[1] * sample - k[3] * y + eq_limiter->state[b][1][c];
+					eq_limiter->state[b][1][c] = k[2] * sample - k[4] * y;
+					sample = y;
+				}
+				x[c] = sample;
+				if (!peaks)
+					continue;
+				float *h[4] = {&eq_limiter->history[0][c], &eq_limiter->history[1][c], &eq_limiter->history[2][c],
+					       &eq_limiter->history[3][c]};
+				*h[0] = *h[1];
+				*h[1] = *h[2];
+				*h[2] = *h[3];
+				*h[3] = sample;
+				peak = fmaxf(peak, fabsf(sample));
+				for (size_t point = 0; point < 4; point++) {
+					float p = 0.0f;
+					for (size_t k = 0; k < 4; k++)
+						p += *h[k] * audio_dsp_peak_weights[k][point];
+					peak = fmaxf(peak, fabsf(p));
+				}
+			}
+			if (peaks)
+				peaks[frame] = peak;
+		}
+	}
+};
+
+#ifdef AUDIO_DSP_X86
+/* Partial loads and stores of the last channels of a frame, going through a padded copy would stall store forwarding on
+ * every frame */
+AUDIO_DSP_TARGET("sse2")
+static inline __m128 audio_dsp_load_lanes_sse2(const float *src, uint32_t lanes)
+{
+	switch (lanes) {
+	case 1:
+		return _mm_load_ss(src);
+	case 2:
+		return _mm_castpd_ps(_mm_load_sd((const double *)src));
+	case 3:
+		return _mm_movelh_ps(_mm_castpd_ps(_mm_load_sd((const double *)src)), _mm_load_ss(src + 2));
+	default:
+		return _mm_loadu_ps(src);
+	}
+}
+
+AUDIO_DSP_TARGET("sse2")
+static inline void audio_dsp_store_lanes_sse2(float *dst, __m128 v, uint32_t lanes)
+{
+	switch (lanes) {
+	case 1:
+		_mm_store_ss(dst, v);
+		break;
+	case 2:
+		_mm_store_sd((double *)dst, _mm_castps_pd(v));
+		break;
+	case 3:
+		_mm_store_sd((double *)dst, _mm_castps_pd(v));
+		_mm_store_ss(dst + 2, _mm_movehl_ps(v, v));
+		break;
+	default:
+		_mm_storeu_ps(dst, v);
+	}
+}
+
+template<uint32_t Channels> struct audio_dsp_eq_limiter_sse2 {
+	AUDIO_DSP_TARGET("sse2")
+	static void run(struct audio_dsp_eq_limiter *eq_limiter, float *samples, size_t frames, float *peaks)
+	{
+		const uint32_t count = audio_dsp_channels<Channels>(eq_limiter->channels);
+		const uint32_t bands = eq_limiter->bands;
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		__m128 weights[4][4];
+		for (size_t k = 0; k < 4; k++) {
+			for (size_t point = 0; point < 4; point++)
+				weights[k][point] = _mm_set1_ps(audio_dsp_peak_weights[k][point]);
+		}
+		__m128 coefficients[AUDIO_DSP_EQ_BANDS][5];
+		for (uint32_t b = 0; b < bands; b++) {
+			for (size_t i = 0; i < 5; i++)
+				coefficients[b][i] = _mm_set1_ps(eq_limiter->coefficients[b][i]);
+		}
+
+		for (uint32_t first = 0; first < count; first += 4) {
+			const uint32_t lanes = count - first < 4 ? count - first : 4;
+			__m128 state[AUDIO_DSP_EQ_BANDS][2];
+			for (uint32_t b = 0; b < bands; b++) {
+				state[b][0] = _mm_loadu_ps(&eq_limiter->state[b][0][first]);
+				state[b][1] = _mm_loadu_ps(&eq_limiter->state[b][1][first]);
+			}
+			__m128 h[4];
+			for (size_t k = 0; k < 4; k++)
+				h[k] = _mm_loadu_ps(&eq_limiter->history[k][first]);
+
+			for (size_t frame = 0; frame < frames; frame++) {
+				float *x = samples + frame * count + first;
+				__m128 v = audio_dsp_load_lanes_sse2(x, lanes);
+				for (uint32_t b = 0; b < bands; b++) {
+					const __m128 *k = coefficients[b];
+					const __m128 y = _mm_add_ps(_mm_mul_ps(k[0], v), state[b][0]);
+					state[b][0] = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(k[1], v), _mm_mul_ps(k[3], y)), state[b][1]);
+					state[b][1] = _mm_sub_ps(_mm_mul_ps(k[2], v), _mm_mul_ps(k[4], y));
+					v = y;
+				}
+				audio_dsp_store_lanes_sse2(x, v, lanes);
+				if (!peaks)
+					continue;
+				h[0] = h[1];
+				h[1] = h[2];
+				h[2] = h[3];
+				h[3] = v;
+				__m128 peak = _mm_andnot_ps(sign, v);
+				for (size_t point = 0; point < 4; point++) {
+					__m128 p = _mm_mul_ps(h[0], weights[0][point]);
+					p = _mm_add_ps(p, _mm_mul_ps(h[1], weights[1][point]));
+					p = _mm_add_ps(p, _mm_mul_ps(h[2], weights[2][point]));
+					p = _mm_add_ps(p, _mm_mul_ps(h[3], weights[3][point]));
+					peak = _mm_max_ps(peak, _mm_andnot_ps(sign, p));
+				}
+				peak = _mm_max_ps(peak, _mm_movehl_ps(peak, peak));
+				peak = _mm_max_ss(peak, _mm_shuffle_ps(peak, peak, _MM_SHUFFLE(1, 1, 1, 1)));
+				const float max = _mm_cvtss_f32(peak);
+				peaks[frame] = first ? fmaxf(peaks[frame], max) : max;
+			}
+
+			for (uint32_t b = 0; b < bands; b++) {
+				_mm_storeu_ps(&eq_limiter->state[b][0][first], state[b][0]);
+				_mm_storeu_ps(&eq_limiter->state[b][1][first], state[b][1]);
+			}
+			for (size_t k = 0; k < 4; k++)
+				_mm_storeu_ps(&eq_limiter->history[k][first], h[k]);
+		}
+	}
+};
+#endif
+
+#ifdef AUDIO_DSP_NEON
+static inline float32x4_t audio_dsp_load_lanes_neon(const float *src, uint32_t lanes)
+{
+	const float32x2_t zero = vdup_n_f32(0.0f);
+	switch (lanes) {
+	case 1:
+		return vcombine_f32(vld1_lane_f32(src, zero, 0), zero);
+	case 2:
+		return vcombine_f32(vld1_f32(src), zero);
+	case 3:
+		return vcombine_f32(vld1_f32(src), vld1_lane_f32(src + 2, zero, 0));
+	default:
+		return vld1q_f32(src);
+	}
+}
+
+static inline void audio_dsp_store_lanes_neon(float *dst, float32x4_t v, uint32_t lanes)
+{
+	switch (lanes) {
+	case 1:
+		vst1q_lane_f32(dst, v, 0);
+		break;
+	case 2:
+		vst1_f32(dst, vget_low_f32(v));
+		break;
+	case 3:
+		vst1_f32(dst, vget_low_f32(v));
+		vst1q_lane_f32(dst + 2, v, 2);
+		break;
+	default:
+		vst1q_f32(dst, v);
+	}
+}
+
+template<uint32_t Channels> struct audio_dsp_eq_limiter_neon {
+	static void run(struct audio_dsp_eq_limiter *eq_limiter, float *samples, size_t frames, float *peaks)
+	{
+		const uint32_t count = audio_dsp_channels<Channels>(eq_limiter->channels);
+		const uint32_t bands = eq_limiter->bands;
+		for (uint32_t first = 0; first < count; first += 4) {
+			const uint32_t lanes = count - first < 4 ? count - first : 4;
+			float32x4_t state[AUDIO_DSP_EQ_BANDS][2];
+			for (uint32_t b = 0; b < bands; b++) {
+				state[b][0] = vld1q_f32(&eq_limiter->state[b][0][first]);
+				state[b][1] = vld1q_f32(&eq_limiter->state[b][1][first]);
+			}
+			float32x4_t h[4];
+			for (size_t k = 0; k < 4; k++)
+				h[k] = vld1q_f32(&eq_limiter->history[k][first]);
+
+			for (size_t frame = 0; frame < frames; frame++) {
+				float *x = samples + frame * count + first;
+				float32x4_t v = audio_dsp_load_lanes_neon(x, lanes);
+				for (uint32_t b = 0; b < bands; b++) {
+					const float *k = eq_limiter->coefficients[b];
+					const float32x4_t y = vmlaq_n_f32(state[b][0], v, k[0]);
+					state[b][0] = vmlsq_n_f32(vmlaq_n_f32(state[b][1], v, k[1]), y, k[3]);
+					state[b][1] = vmlsq_n_f32(vmulq_n_f32(v, k[2]), y, k[4]);
+					v = y;
+				}
+				audio_dsp_store_lanes_neon(x, v, lanes);
+				if (!peaks)
+					continue;
+				h[0] = h[1];
+				h[1] = h[2];
+				h[2] = h[3];
+				h[3] = v;
+				float32x4_t peak = vabsq_f32(v);
+				for (size_t point = 0; point < 4; point++) {
+					float32x4_t p = vmulq_n_f32(h[0], audio_dsp_peak_weights[0][point]);
+					p = vmlaq_n_f32(p, h[1], audio_dsp_peak_weights[1][point]);
+					p = vmlaq_n_f32(p, h[2], audio_dsp_peak_weights[2][point]);
+					p = vmlaq_n_f32(p, h[3], audio_dsp_peak_weights[3][point]);
+					peak = vmaxq_f32(peak, vabsq_f32(p));
+				}
+				const float max = vmaxvq_f32(peak);
+				peaks[frame] = first ? fmaxf(peaks[frame], max) : max;
+			}
+
+			for (uint32_t b = 0; b < bands; b++) {
+				vst1q_f32(&eq_limiter->state[b][0][first], state[b][0]);
+				vst1q_f32(&eq_limiter->state[b][1][first], state[b][1]);
+			}
+			for (size_t k = 0; k < 4; k++)
+				vst1q_f32(&eq_limiter->history[k][first], h[k]);
+		}
+	}
+};
+#endif
+
+static bool audio_dsp_same_eq_limiter_settings(const struct audio_dsp_eq_limiter_settings *a,
+					       const struct audio_dsp_eq_limiter_settings *b)
+{
+	for (size_t i = 0; i < AUDIO_DSP_EQ_BANDS; i++) {
+		if (a->gain_db[i] != b->gain_db[i] || a->frequency[i] != b->frequency[i])
+			return false;
+	}
+	return a->limiter == b->limiter && a->ceiling_db == b->ceiling_db && a->release_ms == b->release_ms;
+}
+
+/* Audio EQ cookbook, band 0 is a low shelf, 1 a peak with a Q of 1 and 2 a high shelf, all with a slope of 1 */
+static void audio_dsp_eq_band(float *coefficients, size_t band, double gain_db, double frequency, double samples_per_sec)
+{
+	if (fabs(gain_db) < 0.01) {
+		const float identity[5] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+		memcpy(coefficients, identity, sizeof(identity));
+		return;
+	}
+	frequency = fmin(fmax(frequency, 10.0), samples_per_sec * 0.45);
+	const double a = pow(10.0, gain_db / 40.0);
+	const double w0 = 2.0 * M_PI * frequency / samples_per_sec;
+	const double cw = cos(w0);
+	double alpha = sin(w0) / 2.0 * sqrt(2.0);
+	double b[3];
+	double d[3];
+	if (band == 1) {
+		alpha = sin(w0) / 2.0;
+		b[0] = 1.0 + alpha * a;
+		b[1] = -2.0 * cw;
+		b[2] = 1.0 - alpha * a;
+		d[0] = 1.0 + alpha / a;
+		d[1] = -2.0 * cw;
+		d[2] = 1.0 - alpha / a;
+	} else {
+		// The high shelf is the low shelf with the sign of the cosine terms flipped.
+		const double s = band == 0 ? 1.0 : -1.0;
+		const double root = 2.0 * sqrt(a) * alpha;
+		b[0] = a * ((a + 1.0) - s * (a - 1.0) * cw + root);
+		b[1] = s * 2.0 * a * ((a - 1.0) - s * (a + 1.0) * cw);
+		b[2] = a * ((a + 1.0) - s * (a - 1.0) * cw - root);
+		d[0] = (a + 1.0) + s * (a - 1.0) * cw + root;
+		d[1] = -s * 2.0 * ((a - 1.0) + s * (a + 1.0) * cw);
+		d[2] = (a + 1.0) + s * (a - 1.0) * cw - root;
+	}
+	coefficients[0] = (float)(b[0] / d[0]);
+	coefficients[1] = (float)(b[1] / d[0]);
+	coefficients[2] = (float)(b[2] / d[0]);
+	coefficients[3] = (float)(d[1] / d[0]);
+	coefficients[4] = (float)(d[2] / d[0]);
+}
+
+bool audio_dsp_eq_limiter_update(struct audio_dsp_eq_limiter *eq_limiter, const struct audio_dsp_eq_limiter_settings *settings,
+				 uint32_t channels, uint32_t samples_per_sec)
+{
+	const bool layout = eq_limiter->channels != channels || eq_limiter->samples_per_sec != samples_per_sec;
+	if (!layout && eq_limiter->kernel && audio_dsp_same_eq_limiter_settings(&eq_limiter->settings, settings))
+		return false;
+	if (!channels || channels > MAX_AUDIO_CHANNELS || !samples_per_sec)
+		return false;
+
+	if (layout || !eq_limiter->kernel) {
+		memset(eq_limiter, 0, sizeof(*eq_limiter));
+		eq_limiter->channels = channels;
+		eq_limiter->samples_per_sec = samples_per_sec;
+		switch (audio_dsp_gain_isa) {
+#ifdef AUDIO_DSP_X86
+		case AUDIO_DSP_ISA_AVX2:
+		case AUDIO_DSP_ISA_SSE2:
+			eq_limiter->kernel = audio_dsp_specialize<audio_dsp_eq_limiter_sse2>(channels);
+			break;
+#endif
+#ifdef AUDIO_DSP_NEON
+		case AUDIO_DSP_ISA_NEON:
+			eq_limiter->kernel = audio_dsp_specialize<audio_dsp_eq_limiter_neon>(channels);
+			break;
+#endif
+		default:
+			eq_limiter->kernel = audio_dsp_specialize<audio_dsp_eq_limiter_scalar>(channels);
+		}
+	}
+	eq_limiter->settings = *settings;
+
+	// Bands at 0 dB stay in the chain as identity while another band is active, so moving one through 0 does not
+	// drop its state.
+	bool active = false;
+	for (size_t b = 0; b < AUDIO_DSP_EQ_BANDS; b++) {
+		audio_dsp_eq_band(eq_limiter->coefficients[b], b, settings->gain_db[b], settings->frequency[b], samples_per_sec);
+		active = active || fabsf(settings->gain_db[b]) >= 0.01f;
+	}
+	if (active && !eq_limiter->bands)
+		memset(eq_limiter->state, 0, sizeof(eq_limiter->state));
+	eq_limiter->bands = active ? AUDIO_DSP_EQ_BANDS : 0;
+
+	if (settings->limiter) {
+		if (!eq_limiter->limiter) {
+			uint32_t lookahead = (uint32_t)((uint64_t)samples_per_sec * AUDIO_DSP_LIMITER_LOOKAHEAD_MS / 1000);
+			if (lookahead < 1)
+				lookahead = 1;
+			if (lookahead > AUDIO_DSP_LIMITER_MAX_LOOKAHEAD)
+				lookahead = AUDIO_DSP_LIMITER_MAX_LOOKAHEAD;
+			eq_limiter->lookahead = lookahead;
+			eq_limiter->required_head = 0;
+			eq_limiter->required_count = 0;
+			eq_limiter->frame = 0;
+			eq_limiter->recovered = 1.0f;
+			for (uint32_t i = 0; i < lookahead; i++)
+				eq_limiter->smooth[i] = 1.0f;
+			eq_limiter->smooth_pos = 0;
+			eq_limiter->smooth_sum = lookahead;
+			memset(eq_limiter->delay, 0, sizeof(eq_limiter->delay));
+			eq_limiter->delay_pos = 0;
+			memset(eq_limiter->history, 0, sizeof(eq_limiter->history));
+		}
+		eq_limiter->ceiling = powf(10.0f, fminf(settings->ceiling_db, 0.0f) / 20.0f);
+		const double release_frames = fmax(settings->release_ms, 1.0) * samples_per_sec / 1000.0;
+		eq_limiter->release = (float)(1.0 - exp(-1.0 / release_frames));
+	}
+	eq_limiter->limiter = settings->limiter;
+	return true;
+}
+
+/* The gain a frame needs is held as the minimum over lookahead + 2 frames, recovers with the release and is averaged
+ * over lookahead frames. Every gain in that average is at or below what the frames lookahead + 1 back need, together
+ * with the 2 frames the true peak trails the samples, so the audio delayed by lookahead + 1 frames never goes over. */
+static void audio_dsp_limit(struct audio_dsp_eq_limiter *eq_limiter, float *samples, size_t frames, const float *peaks)
+{
+	// The state lives in locals for the block, the samples could alias the struct otherwise.
+	const uint32_t channels = eq_limiter->channels;
+	const uint32_t lookahead = eq_limiter->lookahead;
+	const uint32_t window = lookahead + 2;
+	const float ceiling = eq_limiter->ceiling;
+	const float release = eq_limiter->release;
+	const double average = 1.0 / lookahead;
+	float *required = eq_limiter->required;
+	uint64_t *required_frame = eq_limiter->required_frame;
+	uint32_t head = eq_limiter->required_head;
+	uint32_t count = eq_limiter->required_count;
+	uint64_t current = eq_limiter->frame;
+	float recovered = eq_limiter->recovered;
+	float *smooth = eq_limiter->smooth;
+	uint32_t smooth_pos = eq_limiter->smooth_pos;
+	double smooth_sum = eq_limiter->smooth_sum;
+	uint32_t delay_pos = eq_limiter->delay_pos;
+
+	for (size_t frame = 0; frame < frames; frame++, current++) {
+		const float needed = peaks[frame] > ceiling ? ceiling / peaks[frame] : 1.0f;
+		if (count && required_frame[head] + window <= current) {
+			if (++head == window)
+				head = 0;
+			count--;
+		}
+		while (count) {
+			uint32_t back = head + count - 1;
+			if (back >= window)
+				back -= window;
+			if (required[back] < needed)
+				break;
+			count--;
+		}
+		uint32_t tail = head + count;
+		if (tail >= window)
+			tail -= window;
+		required[tail] = needed;
+		required_frame[tail] = current;
+		count++;
+
+		// Ternaries instead of fminf and fmaxf, which compile to calls without finite math.
+		const float released = recovered + (1.0f - recovered) * release;
+		recovered = required[head] < released ? required[head] : released;
+		smooth_sum += recovered - smooth[smooth_pos];
+		smooth[smooth_pos] = recovered;
+		if (++smooth_pos == lookahead)
+			smooth_pos = 0;
+		const float averaged = (float)(smooth_sum * average);
+		const float gain = averaged < 1.0f ? averaged : 1.0f;
+
+		float *delayed = eq_limiter->delay + delay_pos * channels;
+		float *x = samples + frame * channels;
+		for (uint32_t c = 0; c < channels; c++) {
+			const float out = delayed[c] * gain;
+			delayed[c] = x[c];
+			x[c] = out > ceiling ? ceiling : (out < -ceiling ? -ceiling : out);
+		}
+		if (++delay_pos == lookahead + 1)
+			delay_pos = 0;
+	}
+
+	eq_limiter->required_head = head;
+	eq_limiter->required_count = count;
+	eq_limiter->frame = current;
+	eq_limiter->recovered = recovered;
+	eq_limiter->smooth_pos = smooth_pos;
+	eq_limiter->smooth_sum = smooth_sum;
+	eq_limiter->delay_pos = delay_pos;
+}
+
+void audio_dsp_eq_limiter_process(struct audio_dsp_eq_limiter *eq_limiter, float *samples, size_t frames)
+{
+	if (!eq_limiter->kernel || (!eq_limiter->bands && !eq_limiter->limiter))
+		return;
+
+	float peaks[256];
+	for (size_t done = 0; done < frames;) {
+		const size_t chunk = frames - done < 256 ? frames - done : 256;
+		float *block = samples + done * eq_limiter->channels;
+		eq_limiter->kernel(eq_limiter, block, chunk, eq_limiter->limiter ? peaks : nullptr);
+		if (eq_limiter->limiter)
+			audio_dsp_limit(eq_limiter, block, chunk, peaks);
+		done += chunk;
+	}
+
+	// A decaying band would end in denormals after the audio goes silent.
+	float *state = &eq_limiter->state[0][0][0];
+	for (size_t i = 0; i < sizeof(eq_limiter->state) / sizeof(float); i++) {
+		if (fabsf(state[i]) < 1e-15f)
+			state[i] = 0.0f;
+	}
+}
+
+void audio_dsp_eq_limiter_reset(struct audio_dsp_eq_limiter *eq_limiter)
+{
+	memset(eq_limiter, 0, sizeof(*eq_limiter));
+}
+
+uint64_t audio_dsp_eq_limiter_get_latency_ns(const struct audio_dsp_eq_limiter *eq_limiter)
+{
+	if (!eq_limiter->limiter || !eq_limiter->samples_per_sec)
+		return 0;
+	return (uint64_t)(eq_limiter->lookahead + 1) * 1000000000ULL / eq_limiter->samples_per_sec;
+}
+
+void audio_dsp_init(void)
+{
+#if defined(AUDIO_DSP_X86)
+	if (audio_dsp_cpu_has(false)) {
+		audio_dsp_convert_isa = AUDIO_DSP_ISA_SSE2;
+		audio_dsp_gain_isa = AUDIO_DSP_ISA_SSE2;
+		audio_dsp_kernel_name = "sse2";
+	}
+	if (audio_dsp_cpu_has(true)) {
+		audio_dsp_gain_isa = AUDIO_DSP_ISA_AVX2;
+		audio_dsp_kernel_name = "avx2";
+	}
+#elif defined(AUDIO_DSP_NEON)
+	audio_dsp_convert_isa = AUDIO_DSP_ISA_NEON;
+	audio_dsp_gain_isa = AUDIO_DSP_ISA_NEON;
+	audio_dsp_kernel_name = "neon";
+#endif
+	blog(LOG_INFO, "[Audio Monitor] using %s audio kernels", audio_dsp_kernel_name);
+}
+
+const char *audio_dsp_get_kernel_name(void)
+{
+	return audio_dsp_kernel_name;
+}
@@ -0,0 +1,175 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <media-io/audio-io.h>
+#include <media-io/audio-resampler.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Picks the fastest kernels the CPU supports, called once when the module loads */
+void audio_dsp_init(void);
+const char *audio_dsp_get_kernel_name(void);
+
+struct audio_dsp_matrix;
+typedef void (*audio_dsp_matrix_func)(const struct audio_dsp_matrix *matrix, const float *in, float *out, size_t frames);
+
+/* Gain matrix from input to output channels for downmix, upmix, channel picking and pan laws, applied in one pass.
+ * Each monitor keeps one so the coefficients are only rebuilt when its settings change, zero initialized means
+ * nothing built yet. */
+struct audio_dsp_matrix {
+	uint32_t in_channels;
+	uint32_t out_channels;
+	/* kernel specialized for the channel count, with a diagonal only matrix a plain gain per channel */
+	audio_dsp_matrix_func kernel;
+	/* the diagonal over 8 frames, only filled for a diagonal matrix */
+	float pattern[MAX_AUDIO_CHANNELS * 8];
+	/* gain of each input into each output, repeated over the 8 lanes when there are fewer outputs */
+	float columns[MAX_AUDIO_CHANNELS][8];
+
+	/* settings the presets were built from */
+	uint32_t channels;
+	float volume;
+	float balance;
+	bool mono;
+	int channel_pair;
+};
+
+/* Sets any matrix, coefficients holds a row of in_channels gains for every output */
+void audio_dsp_matrix_set(struct audio_dsp_matrix *matrix, uint32_t in_channels, uint32_t out_channels, const float *coefficients);
+
+/* Builds the presets in the OBS speaker layout of channels when a setting differs from the cached ones, returns true
+ * when it did. A channel pair above 0 plays only that pair, 1 is channels 1 and 2, on the front pair. Mono averages
+ * all channels but the LFE, balance moves every left and right channel. */
+bool audio_dsp_matrix_update(struct audio_dsp_matrix *matrix, uint32_t channels, float volume, bool mono, float balance,
+			     int channel_pair);
+
+/* Volume with the balance pan law of every output channel, what the presets put on the outputs */
+void audio_dsp_channel_gains(float *gains, uint32_t channels, float volume, float balance);
+
+/* Applies the matrix to interleaved float, in and out can be the same buffer when the counts are equal */
+void audio_dsp_apply(const struct audio_dsp_matrix *matrix, const float *in, float *out, size_t frames);
+
+/* Brings the planar float mix of OBS to interleaved float at the rate and layout of an output. Same contract as the
+ * libobs resampler, but when the rate and layout already match it only interleaves the planes instead of going
+ * through libswresample, and with the same layout a quality above AUDIO_DSP_RESAMPLER_LIBOBS changes the rate with
+ * the built in polyphase resampler.
+ *
+ * Monitors fed the same blocks, like every device of a track in the dock, pass the same stream and share one
+ * conversion per output spec and quality, a block is then converted once and every monitor reads the result. The
+ * result is read only and valid until the next block, pass a NULL stream to never share. */
+struct audio_dsp_resampler;
+
+/* More taps cost more CPU and delay but keep more of the top octave and alias less */
+enum audio_dsp_resampler_quality {
+	AUDIO_DSP_RESAMPLER_LIBOBS,
+	AUDIO_DSP_RESAMPLER_FAST,
+	AUDIO_DSP_RESAMPLER_BALANCED,
+	AUDIO_DSP_RESAMPLER_MASTERING,
+};
+
+struct audio_dsp_resampler *audio_dsp_resampler_create(const struct resample_info *dst, const struct resample_info *src,
+							int quality, const void *stream);
+void audio_dsp_resampler_destroy(struct audio_dsp_resampler *resampler);
+bool audio_dsp_resampler_resample(struct audio_dsp_resampler *resampler, const uint8_t *output[], uint32_t *out_frames,
+				  uint64_t *ts_offset, const uint8_t *const input[], uint32_t in_frames, uint64_t timestamp);
+/* Delay the resampler adds to the monitor */
+uint64_t audio_dsp_resampler_get_latency_ns(const struct audio_dsp_resampler *resampler);
+
+/* Noise state of the TPDF dither, one per output so outputs do not share a sequence */
+struct audio_dsp_dither {
+	uint32_t state[4];
+};
+
+void audio_dsp_dither_init(struct audio_dsp_dither *dither, uint32_t seed);
+
+/* Converts interleaved float to a packed format as the last step of the pipeline. Samples are clamped to -1..1 and
+ * rounded, with dither they first get triangular noise of one step of the output format, pass NULL for none. */
+typedef void (*audio_dsp_convert_func)(const float *in, uint8_t *out, size_t samples, struct audio_dsp_dither *dither);
+
+/* The conversion specialized for a format, looked up once when an output starts, NULL for unknown formats */
+audio_dsp_convert_func audio_dsp_get_convert(enum audio_format format);
+
+/* Monitor only EQ and limiter, run on the interleaved float of one monitor after its matrix so the stream mix is never
+ * touched. The bands are a low shelf, a peak and a high shelf, a band at 0 dB is left out. The limiter looks ahead
+ * AUDIO_DSP_LIMITER_LOOKAHEAD_MS to bring the true peak of every frame below the ceiling before it plays, the gain
+ * is the same for all channels and recovers with the release time. */
+#define AUDIO_DSP_EQ_BANDS 3
+#define AUDIO_DSP_LIMITER_LOOKAHEAD_MS 2
+/* lookahead frames are capped here, above 256 kHz the lookahead gets shorter */
+#define AUDIO_DSP_LIMITER_MAX_LOOKAHEAD 512
+
+struct audio_dsp_eq_limiter_settings {
+	float gain_db[AUDIO_DSP_EQ_BANDS];
+	float frequency[AUDIO_DSP_EQ_BANDS];
+	bool limiter;
+	float ceiling_db;
+	float release_ms;
+};
+
+struct audio_dsp_eq_limiter;
+typedef void (*audio_dsp_eq_limiter_func)(struct audio_dsp_eq_limiter *eq_limiter, float *samples, size_t frames,
+					  float *peaks);
+
+/* Each monitor keeps one next to its matrix, zero initialized means nothing built yet. Only touched by the thread that
+ * processes the audio of the monitor. */
+struct audio_dsp_eq_limiter {
+	struct audio_dsp_eq_limiter_settings settings;
+	uint32_t channels;
+	uint32_t samples_per_sec;
+	/* EQ of the active bands and the true peak of every frame, specialized for the channel count */
+	audio_dsp_eq_limiter_func kernel;
+
+	uint32_t bands;
+	/* b0, b1, b2, a1 and a2 of every active band, normalized to a0 */
+	float coefficients[AUDIO_DSP_EQ_BANDS][5];
+	/* transposed direct form II state of every band and channel */
+	float state[AUDIO_DSP_EQ_BANDS][2][MAX_AUDIO_CHANNELS];
+	/* last 4 samples of every channel for the true peak */
+	float history[4][MAX_AUDIO_CHANNELS];
+
+	bool limiter;
+	float ceiling;
+	float release;
+	uint32_t lookahead;
+	/* gain each frame needs, the minimum over lookahead + 2 frames as a monotonic queue */
+	float required[AUDIO_DSP_LIMITER_MAX_LOOKAHEAD + 2];
+	uint64_t required_frame[AUDIO_DSP_LIMITER_MAX_LOOKAHEAD + 2];
+	uint32_t required_head;
+	uint32_t required_count;
+	uint64_t frame;
+	float recovered;
+	/* recovered gains averaged over lookahead frames so the gain ramps instead of steps */
+	float smooth[AUDIO_DSP_LIMITER_MAX_LOOKAHEAD];
+	uint32_t smooth_pos;
+	double smooth_sum;
+	/* the audio delayed by lookahead + 1 frames while the gain catches up */
+	float delay[(AUDIO_DSP_LIMITER_MAX_LOOKAHEAD + 1) * MAX_AUDIO_CHANNELS];
+	uint32_t delay_pos;
+};
+
+/* Rebuilds the coefficients when a setting differs from the cached ones and resets the state when the layout or rate
+ * changes, returns true when it did */
+bool audio_dsp_eq_limiter_update(struct audio_dsp_eq_limiter *eq_limiter, const struct audio_dsp_eq_limiter_settings *settings,
+				 uint32_t channels, uint32_t samples_per_sec);
+
+/* Processes interleaved float in place, does nothing when every band is at 0 dB and the limiter is off */
+void audio_dsp_eq_limiter_process(struct audio_dsp_eq_limiter *eq_limiter, float *samples, size_t frames);
+
+/* Back to nothing built, for a monitor that stops so it does not replay the end of its last run */
+void audio_dsp_eq_limiter_reset(struct audio_dsp_eq_limiter *eq_limiter);
+
+/* Delay the lookahead of the limiter adds to the monitor */
+uint64_t audio_dsp_eq_limiter_get_latency_ns(const struct audio_dsp_eq_limiter *eq_limiter);
+
+/* Peak of one plane for the meters of the dock, including the peaks between samples found by oversampling 4x with a
+ * sinc like the volume meter of OBS. history holds the last 4 samples of the previous block and is updated. */
+float audio_dsp_true_peak(const float *samples, size_t frames, float history[4]);
+
+/* Root mean square of one plane */
+float audio_dsp_magnitude(const float *samples, size_t frames);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,560 @@
+#include "audio-monitor-alsa.h"
+#include "audio-monitor-filter.h"
+#include "audio-monitor-ring.h"
+#include <obs.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#include <media-io/audio-resampler.h>
+
+/* period and period count asked from the device, keeps the hardware buffer under 10 ms */
+#define ALSA_PERIOD_USEC 2500
+#define ALSA_PERIODS 3
+/* how long the writer thread waits for the device before checking if it should stop */
+#define ALSA_WAIT_MS 100
+
+struct audio_monitor {
+	snd_pcm_t *pcm;
+	snd_pcm_format_t format;
+	bool mmap;
+	snd_pcm_uframes_t period_size;
+	snd_pcm_uframes_t buffer_size;
+	uint_fast32_t samples_per_sec;
+	uint_fast32_t bytes_per_frame;
+
+	uint_fast8_t channels;
+
+	/* interleaved float at the rate and channels of the device */
+	struct audio_ring ring;
+	/* one period of float read from the ring, converted into the device buffer */
+	float *period;
+	/* one period in the device format, only used when the device can not be mapped */
+	uint8_t *output;
+	/* float to the format of the device, devices of 16 bits or less get TPDF dither */
+	audio_dsp_convert_func convert;
+	bool dither;
+	struct audio_dsp_dither dither_state;
+
+	pthread_t thread;
+	volatile bool thread_active;
+	volatile long xruns;
+
+	struct audio_dsp_resampler *resampler;
+	/* monitors of the same stream share the conversion of each block */
+	const void *shared_stream;
+	/* audio_dsp_resampler_quality used from the next start */
+	int resampler_quality;
+	float volume;
+	bool mono;
+	float balance;
+	/* only this pair of channels is played when above 0 */
+	int channel_pair;
+	/* volume, mono, balance and channel pair as a channel matrix, only touched by the thread that processes audio */
+	struct audio_dsp_matrix matrix;
+	/* monitor only EQ and limiter, built from the settings by the thread that processes audio */
+	struct audio_dsp_eq_limiter_settings eq_limiter_settings;
+	struct audio_dsp_eq_limiter eq_limiter;
+	pthread_mutex_t mutex;
+	char *device_id;
+	char *source_name;
+
+	/* set once the writer thread runs, the audio thread drops audio until then */
+	volatile bool ready;
+
+	/* latency ceiling of the ring, its policy and the audio it discarded */
+	struct monitor_latency latency;
+};
+
+static enum speaker_layout alsa_channels_to_obs_speakers(unsigned int channels)
+{
+	switch (channels) {
+	case 1:
+		return SPEAKERS_MONO;
+	case 2:
+		return SPEAKERS_STEREO;
+	case 3:
+		return SPEAKERS_2POINT1;
+	case 4:
+		return SPEAKERS_4POINT0;
+	case 5:
+		return SPEAKERS_4POINT1;
+	case 6:
+		return SPEAKERS_5POINT1;
+	case 8:
+		return SPEAKERS_7POINT1;
+	default:
+		return SPEAKERS_UNKNOWN;
+	}
+}
+
+void audio_monitor_enum_devices(bool (*cb)(void *data, const char *name, const char *id), void *data)
+{
+	void **hints = NULL;
+	if (snd_device_name_hint(-1, "pcm", &hints) < 0)
+		return;
+
+	for (void **hint = hints; *hint; hint++) {
+		char *name = snd_device_name_get_hint(*hint, "NAME");
+		char *desc = snd_device_name_get_hint(*hint, "DESC");
+		char *ioid = snd_device_name_get_hint(*hint, "IOID");
+		// Hints without IOID can do both directions.
+		bool keep_going = true;
+		if (name && strcmp(name, "default") != 0 && (!ioid || strcmp(ioid, "Output") == 0))
+			keep_going = cb(data, desc ? desc : name, name);
+		free(name);
+		free(desc);
+		free(ioid);
+		if (!keep_going)
+			break;
+	}
+
+	snd_device_name_free_hint(hints);
+}
+
+/* The OBS format matching the sample format of the device, unknown for formats that are never negotiated */
+static enum audio_format alsa_audio_format(snd_pcm_format_t format)
+{
+	switch (format) {
+	case SND_PCM_FORMAT_U8:
+		return AUDIO_FORMAT_U8BIT;
+	case SND_PCM_FORMAT_S16_LE:
+		return AUDIO_FORMAT_16BIT;
+	case SND_PCM_FORMAT_S32_LE:
+		return AUDIO_FORMAT_32BIT;
+	case SND_PCM_FORMAT_FLOAT_LE:
+		return AUDIO_FORMAT_FLOAT;
+	default:
+		return AUDIO_FORMAT_UNKNOWN;
+	}
+}
+
+/* Fills period with frames from the ring, padded with silence when the audio thread is behind */
+static void alsa_fill_period(struct audio_monitor *data, snd_pcm_uframes_t frames)
+{
+	const size_t size = frames * data->bytes_per_frame;
+	const size_t read =
+		monitor_ring_read(&data->ring, &data->latency, (uint32_t)data->samples_per_sec, (uint8_t *)data->period, size);
+	if (read < size)
+		memset((uint8_t *)data->period + read, 0, size - read);
+}
+
+/* Recovers from underruns and suspends, returns false when the device is gone */
+static bool alsa_recover(struct audio_monitor *data, int err)
+{
+	if (err == -EPIPE)
+		os_atomic_inc_long(&data->xruns);
+	err = snd_pcm_recover(data->pcm, err, 1);
+	if (err < 0) {
+		blog(LOG_ERROR, "Monitoring in '%s' could not recover: %s", data->device_id, snd_strerror(err));
+		return false;
+	}
+	return true;
+}
+
+/* Writes one period, straight into the mapped device buffer when possible */
+static int alsa_write_period(struct audio_monitor *data)
+{
+	snd_pcm_uframes_t frames = data->period_size;
+
+	if (!data->mmap) {
+		alsa_fill_period(data, frames);
+		data->convert(data->period, data->output, frames * data->channels, data->dither ? &data->dither_state : NULL);
+		snd_pcm_sframes_t written = snd_pcm_writei(data->pcm, data->output, frames);
+		return written < 0 ? (int)written : 0;
+	}
+
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t offset;
+	int err = snd_pcm_mmap_begin(data->pcm, &areas, &offset, &frames);
+	if (err < 0)
+		return err;
+
+	uint8_t *dst = (uint8_t *)areas[0].addr + areas[0].first / 8 + offset * areas[0].step / 8;
+	alsa_fill_period(data, frames);
+	data->convert(data->period, dst, frames * data->channels, data->dither ? &data->dither_state : NULL);
+
+	snd_pcm_sframes_t committed = snd_pcm_mmap_commit(data->pcm, offset, frames);
+	if (committed < 0)
+		return (int)committed;
+	return committed == (snd_pcm_sframes_t)frames ? 0 : -EPIPE;
+}
+
+static void *alsa_writer_thread(void *param)
+{
+	struct audio_monitor *data = param;
+	os_set_thread_name("audio-monitor: alsa");
+
+	// Best effort, without the right limits this stays a normal thread.
+	struct sched_param sched = {.sched_priority = 1};
+	pthread_setschedparam(pthread_self(), SCHED_FIFO, &sched);
+
+	while (os_atomic_load_bool(&data->thread_active)) {
+		snd_pcm_sframes_t avail = snd_pcm_avail_update(data->pcm);
+		if (avail < 0) {
+			if (!alsa_recover(data, (int)avail))
+				break;
+			continue;
+		}
+
+		if ((snd_pcm_uframes_t)avail < data->period_size) {
+			int err = snd_pcm_wait(data->pcm, ALSA_WAIT_MS);
+			if (err < 0 && !alsa_recover(data, err))
+				break;
+			continue;
+		}
+
+		// The start threshold starts the device once the first period is in.
+		int err = alsa_write_period(data);
+		if (err < 0 && !alsa_recover(data, err))
+			break;
+	}
+
+	return NULL;
+}
+
+static bool alsa_set_params(struct audio_monitor *audio_monitor, unsigned int rate, unsigned int channels)
+{
+	snd_pcm_t *pcm = audio_monitor->pcm;
+	snd_pcm_hw_params_t *hw;
+	snd_pcm_hw_params_malloc(&hw);
+	snd_pcm_hw_params_any(pcm, hw);
+
+	audio_monitor->mmap = snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0;
+	if (!audio_monitor->mmap && snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_RW_INTERLEAVED) < 0) {
+		blog(LOG_ERROR, "Device '%s' does not support interleaved access", audio_monitor->device_id);
+		snd_pcm_hw_params_free(hw);
+		return false;
+	}
+
+	const snd_pcm_format_t formats[] = {SND_PCM_FORMAT_FLOAT_LE, SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_S16_LE,
+					    SND_PCM_FORMAT_U8};
+	audio_monitor->format = SND_PCM_FORMAT_UNKNOWN;
+	for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		if (snd_pcm_hw_params_set_format(pcm, hw, formats[i]) == 0) {
+			audio_monitor->format = formats[i];
+			break;
+		}
+	}
+
+	int dir = 0;
+	snd_pcm_uframes_t period_size = rate * ALSA_PERIOD_USEC / 1000000;
+	snd_pcm_uframes_t buffer_size = period_size * ALSA_PERIODS;
+	int err = audio_monitor->format == SND_PCM_FORMAT_UNKNOWN ? -EINVAL : 0;
+	if (err == 0)
+		err = snd_pcm_hw_params_set_channels_near(pcm, hw, &channels);
+	if (err == 0)
+		err = snd_pcm_hw_params_set_rate_near(pcm, hw, &rate, &dir);
+	if (err == 0)
+		err = snd_pcm_hw_params_set_period_size_near(pcm, hw, &period_size, &dir);
+	if (err == 0)
+		err = snd_pcm_hw_params_set_buffer_size_near(pcm, hw, &buffer_size);
+	if (err == 0)
+		err = snd_pcm_hw_params(pcm, hw);
+	if (err == 0) {
+		snd_pcm_hw_params_get_period_size(hw, &audio_monitor->period_size, &dir);
+		snd_pcm_hw_params_get_buffer_size(hw, &audio_monitor->buffer_size);
+	}
+	snd_pcm_hw_params_free(hw);
+	if (err < 0) {
+		blog(LOG_ERROR, "Unable to configure '%s': %s", audio_monitor->device_id, snd_strerror(err));
+		return false;
+	}
+
+	snd_pcm_sw_params_t *sw;
+	snd_pcm_sw_params_malloc(&sw);
+	snd_pcm_sw_params_current(pcm, sw);
+	snd_pcm_sw_params_set_start_threshold(pcm, sw, audio_monitor->period_size);
+	snd_pcm_sw_params_set_avail_min(pcm, sw, audio_monitor->period_size);
+	err = snd_pcm_sw_params(pcm, sw);
+	snd_pcm_sw_params_free(sw);
+	if (err < 0) {
+		blog(LOG_ERROR, "Unable to configure '%s': %s", audio_monitor->device_id, snd_strerror(err));
+		return false;
+	}
+
+	audio_monitor->samples_per_sec = rate;
+	audio_monitor->channels = (uint_fast8_t)channels;
+	return true;
+}
+
+void audio_monitor_stop(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor)
+		return;
+
+	// Keep the audio thread out, then stop the writer before the device goes away.
+	os_atomic_set_bool(&audio_monitor->ready, false);
+	pthread_mutex_lock(&audio_monitor->mutex);
+
+	if (os_atomic_load_bool(&audio_monitor->thread_active)) {
+		os_atomic_set_bool(&audio_monitor->thread_active, false);
+		pthread_join(audio_monitor->thread, NULL);
+
+		blog(LOG_INFO,
+		     "Stopped Monitoring in '%s', %ld underruns, %" PRIu64 " ms of audio discarded to keep latency bounded",
+		     audio_monitor->device_id, os_atomic_load_long(&audio_monitor->xruns),
+		     audio_monitor_get_discarded_ms(audio_monitor));
+	}
+
+	if (audio_monitor->pcm) {
+		snd_pcm_drop(audio_monitor->pcm);
+		snd_pcm_close(audio_monitor->pcm);
+		audio_monitor->pcm = NULL;
+	}
+
+	audio_ring_free(&audio_monitor->ring);
+	bfree(audio_monitor->period);
+	audio_monitor->period = NULL;
+	bfree(audio_monitor->output);
+	audio_monitor->output = NULL;
+	monitor_latency_stop(&audio_monitor->latency);
+	audio_dsp_resampler_destroy(audio_monitor->resampler);
+	audio_monitor->resampler = NULL;
+	audio_dsp_eq_limiter_reset(&audio_monitor->eq_limiter);
+
+	pthread_mutex_unlock(&audio_monitor->mutex);
+}
+
+void audio_monitor_start(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor)
+		return;
+
+	audio_monitor_stop(audio_monitor);
+	pthread_mutex_lock(&audio_monitor->mutex);
+
+	int err = snd_pcm_open(&audio_monitor->pcm, audio_monitor->device_id, SND_PCM_STREAM_PLAYBACK, 0);
+	if (err < 0) {
+		blog(LOG_ERROR, "Unable to open '%s': %s", audio_monitor->device_id, snd_strerror(err));
+		audio_monitor->pcm = NULL;
+		pthread_mutex_unlock(&audio_monitor->mutex);
+		return;
+	}
+
+	const struct audio_output_info *info = audio_output_get_info(obs_get_audio());
+	if (!alsa_set_params(audio_monitor, info->samples_per_sec, get_audio_channels(info->speakers)))
+		goto fail;
+
+	audio_monitor->bytes_per_frame = audio_monitor->channels * sizeof(float);
+
+	struct resample_info from = {.samples_per_sec = info->samples_per_sec,
+				     .speakers = info->speakers,
+				     .format = AUDIO_FORMAT_FLOAT_PLANAR};
+	struct resample_info to = {.samples_per_sec = (uint32_t)audio_monitor->samples_per_sec,
+				   .speakers = alsa_channels_to_obs_speakers(audio_monitor->channels),
+				   .format = AUDIO_FORMAT_FLOAT};
+
+	audio_monitor->resampler = audio_dsp_resampler_create(&to, &from, audio_monitor->resampler_quality,
+							      audio_monitor->shared_stream);
+	if (!audio_monitor->resampler) {
+		blog(LOG_WARNING, "%s: %s", __FUNCTION__, "Failed to create resampler");
+		goto fail;
+	}
+
+	audio_ring_init(&audio_monitor->ring, (size_t)audio_monitor->samples_per_sec * MONITOR_RING_USEC / 1000000,
+			audio_monitor->bytes_per_frame);
+	monitor_latency_start(&audio_monitor->latency, (size_t)audio_monitor->samples_per_sec * MONITOR_FADE_USEC / 1000000,
+			      audio_monitor->bytes_per_frame);
+	const enum audio_format format = alsa_audio_format(audio_monitor->format);
+	audio_monitor->convert = audio_dsp_get_convert(format);
+	audio_monitor->dither = format == AUDIO_FORMAT_16BIT || format == AUDIO_FORMAT_U8BIT;
+	audio_dsp_dither_init(&audio_monitor->dither_state, (uint32_t)os_gettime_ns());
+	// mmap_begin can hand out less than a period but never more.
+	audio_monitor->period = bzalloc(audio_monitor->period_size * audio_monitor->bytes_per_frame);
+	if (!audio_monitor->mmap)
+		audio_monitor->output = bzalloc((size_t)snd_pcm_format_size(audio_monitor->format,
+									    audio_monitor->period_size * audio_monitor->channels));
+
+	os_atomic_set_long(&audio_monitor->xruns, 0);
+	os_atomic_set_bool(&audio_monitor->thread_active, true);
+	if (pthread_create(&audio_monitor->thread, NULL, alsa_writer_thread, audio_monitor) != 0) {
+		os_atomic_set_bool(&audio_monitor->thread_active, false);
+		blog(LOG_ERROR, "Unable to start the writer thread");
+		goto fail;
+	}
+
+	blog(LOG_INFO,
+	     "Started Monitoring in '%s', %s %" PRIuFAST32 " Hz %d channels %s, period %lu frames, buffer %lu frames (%.1f ms)",
+	     audio_monitor->device_id, snd_pcm_format_name(audio_monitor->format), audio_monitor->samples_per_sec,
+	     (int)audio_monitor->channels, audio_monitor->mmap ? "mmap" : "read/write", audio_monitor->period_size,
+	     audio_monitor->buffer_size, (double)audio_monitor->buffer_size * 1000.0 / (double)audio_monitor->samples_per_sec);
+
+	pthread_mutex_unlock(&audio_monitor->mutex);
+	os_atomic_set_bool(&audio_monitor->ready, true);
+	return;
+
+fail:
+	pthread_mutex_unlock(&audio_monitor->mutex);
+	audio_monitor_stop(audio_monitor);
+}
+
+void audio_monitor_audio(void *data, struct obs_audio_data *audio)
+{
+	struct audio_monitor *audio_monitor = data;
+	// Drop audio until the writer thread runs.
+	if (!os_atomic_load_bool(&audio_monitor->ready))
+		return;
+	pthread_mutex_lock(&audio_monitor->mutex);
+	if (!os_atomic_load_bool(&audio_monitor->ready) || !audio_monitor->resampler) {
+		pthread_mutex_unlock(&audio_monitor->mutex);
+		return;
+	}
+
+	const uint8_t *resample_data[MAX_AV_PLANES];
+	uint32_t resample_frames;
+	uint64_t ts_offset;
+	bool success = audio_dsp_resampler_resample(audio_monitor->resampler, resample_data, &resample_frames, &ts_offset,
+						    (const uint8_t *const *)audio->data, (uint32_t)audio->frames, audio->timestamp);
+	if (!success) {
+		pthread_mutex_unlock(&audio_monitor->mutex);
+		return;
+	}
+
+	// Other monitors can read the same resampled audio, the matrix leaves it as is and writes straight into the ring.
+	// The writer thread drains the ring.
+	const float *samples = (const float *)resample_data[0];
+	audio_dsp_matrix_update(&audio_monitor->matrix, audio_monitor->channels, audio_monitor->volume, audio_monitor->mono,
+				audio_monitor->balance, audio_monitor->channel_pair);
+	audio_dsp_eq_limiter_update(&audio_monitor->eq_limiter, &audio_monitor->eq_limiter_settings, audio_monitor->channels,
+				    (uint32_t)audio_monitor->samples_per_sec);
+
+	monitor_ring_write(&audio_monitor->ring, &audio_monitor->latency, &audio_monitor->matrix, &audio_monitor->eq_limiter,
+			   samples, resample_frames);
+	pthread_mutex_unlock(&audio_monitor->mutex);
+}
+
+void audio_monitor_set_volume(struct audio_monitor *audio_monitor, float volume)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->volume = volume;
+}
+
+void audio_monitor_set_mono(struct audio_monitor *audio_monitor, bool mono)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->mono = mono;
+}
+
+void audio_monitor_set_balance(struct audio_monitor *audio_monitor, float balance)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->balance = balance;
+}
+
+void audio_monitor_set_channel_pair(struct audio_monitor *audio_monitor, int channel_pair)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->channel_pair = channel_pair;
+}
+
+void audio_monitor_set_stream(struct audio_monitor *audio_monitor, const void *stream)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->shared_stream = stream;
+}
+
+void audio_monitor_set_resampler_quality(struct audio_monitor *audio_monitor, int quality)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->resampler_quality = quality;
+}
+
+void audio_monitor_set_eq_limiter(struct audio_monitor *audio_monitor, const struct audio_dsp_eq_limiter_settings *settings)
+{
+	if (!audio_monitor || !settings)
+		return;
+	audio_monitor->eq_limiter_settings = *settings;
+}
+
+struct audio_monitor *audio_monitor_create(const char *device_id, const char *source_name, int port)
+{
+	UNUSED_PARAMETER(port);
+	struct audio_monitor *audio_monitor = bzalloc(sizeof(struct audio_monitor));
+	audio_monitor->device_id = bstrdup(device_id);
+	audio_monitor->source_name = bstrdup(source_name);
+	monitor_latency_init(&audio_monitor->latency);
+	pthread_mutex_init(&audio_monitor->mutex, NULL);
+	return audio_monitor;
+}
+
+void audio_monitor_destroy(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor_stop(audio_monitor);
+	pthread_mutex_destroy(&audio_monitor->mutex);
+	bfree(audio_monitor->source_name);
+	bfree(audio_monitor->device_id);
+	bfree(audio_monitor);
+}
+
+const char *audio_monitor_get_device_id(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor)
+		return NULL;
+	return audio_monitor->device_id;
+}
+
+void audio_monitor_set_format(struct audio_monitor *audio_monitor, enum audio_format format)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(format);
+}
+
+void audio_monitor_set_samples_per_sec(struct audio_monitor *audio_monitor, long long samples_per_sec)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(samples_per_sec);
+}
+
+void audio_monitor_set_max_latency(struct audio_monitor *audio_monitor, long long max_latency, int policy)
+{
+	if (!audio_monitor)
+		return;
+	monitor_latency_set(&audio_monitor->latency, max_latency, policy);
+}
+
+uint64_t audio_monitor_get_discarded_ms(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor)
+		return 0;
+	return monitor_latency_get_discarded_ms(&audio_monitor->latency, (uint32_t)audio_monitor->samples_per_sec);
+}
+
+/* The period and buffer sizes are fixed, so only the achieved buffer is reported */
+void audio_monitor_set_latency_profile(struct audio_monitor *audio_monitor, int profile, long long custom_ms)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(profile);
+	UNUSED_PARAMETER(custom_ms);
+}
+
+uint64_t audio_monitor_get_latency_ms(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor || !os_atomic_load_bool(&audio_monitor->ready) || !audio_monitor->samples_per_sec)
+		return 0;
+	pthread_mutex_lock(&audio_monitor->mutex);
+	const uint64_t processing_ns = audio_dsp_resampler_get_latency_ns(audio_monitor->resampler) +
+				       audio_dsp_eq_limiter_get_latency_ns(&audio_monitor->eq_limiter);
+	pthread_mutex_unlock(&audio_monitor->mutex);
+	return (uint64_t)audio_monitor->buffer_size * 1000 / audio_monitor->samples_per_sec + processing_ns / 1000000;
+}
+
+void audio_monitor_set_server_volume(struct audio_monitor *audio_monitor, bool server_volume)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(server_volume);
+}
+
+void audio_monitor_set_direct_source(struct audio_monitor *audio_monitor, const char *source)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(source);
+}
@@ -502,7 +502,7 @@ void AudioMonitorDock::ConfigClicked()
 	}
 
 	audioDevices.clear();
-	obs_enum_audio_monitoring_devices(OBSAddAudioDevice, this);
+	audio_monitor_enum_output_devices(OBSAddAudioDevice, this);
 
 	popup.exec(QCursor::pos());
 }
@@ -1,11 +1,13 @@
 #include "audio-monitor-filter.h"
+#include "audio-dsp.h"
+#include "audio-ring.h"
 
 #include "obs-frontend-api.h"
 #include "obs-module.h"
 #include "obs.h"
 #include "version.h"
 
-#include <util/deque.h>
+#include <util/platform.h>
 
 #define MUTE_NEVER 0
 #define MUTE_NOT_ACTIVE 1
@@ -17,13 +19,21 @@ struct audio_monitor_context {
 	obs_source_t *source;
 	struct audio_monitor *monitor;
 	long long delay;
-	struct deque audio_buffer;
+	/* planar float delay line, only touched by the audio thread and reallocated when the delay or the layout changes */
+	struct audio_ring delay_ring[MAX_AV_PLANES];
+	float *delay_block;
+	long long delay_allocated;
+	size_t delay_frames;
+	size_t delay_block_frames;
+	size_t delay_channels;
 	bool linked;
 	bool updating_volume;
 	int mute;
 	bool enabled;
 	bool mute_stop_start;
 	bool parent_loaded;
+	int resampler_quality;
+	const void *stream;
 	obs_hotkey_pair_id hotkey;
 };
 
@@ -166,6 +176,35 @@ static void audio_monitor_frontend_event(enum obs_frontend_event event, void *da
 	}
 }
 
+static void audio_monitor_delay_free(struct audio_monitor_context *audio_monitor)
+{
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		audio_ring_free(&audio_monitor->delay_ring[i]);
+	bfree(audio_monitor->delay_block);
+	audio_monitor->delay_block = NULL;
+	audio_monitor->delay_allocated = 0;
+	audio_monitor->delay_frames = 0;
+	audio_monitor->delay_block_frames = 0;
+	audio_monitor->delay_channels = 0;
+}
+
+/* Called from the audio thread, the audio held back for the old delay is dropped */
+static void audio_monitor_delay_alloc(struct audio_monitor_context *audio_monitor, long long delay, size_t channels,
+				      size_t frames)
+{
+	audio_monitor_delay_free(audio_monitor);
+	const size_t block = frames > AUDIO_OUTPUT_FRAMES ? frames : AUDIO_OUTPUT_FRAMES;
+	audio_monitor->delay_frames = (size_t)delay * audio_output_get_sample_rate(obs_get_audio()) / 1000;
+	// Between two blocks up to delay_frames + block frames are held, room for one more block is written on top.
+	for (size_t i = 0; i < channels; i++)
+		audio_ring_init(&audio_monitor->delay_ring[i], audio_monitor->delay_frames + 2 * block, sizeof(float));
+	if (channels)
+		audio_monitor->delay_block = bmalloc(channels * block * sizeof(float));
+	audio_monitor->delay_allocated = delay;
+	audio_monitor->delay_block_frames = block;
+	audio_monitor->delay_channels = channels;
+}
+
 static void audio_monitor_update(void *data, obs_data_t *settings)
 {
 	struct audio_monitor_context *audio_monitor = data;
@@ -259,18 +298,33 @@ static void audio_monitor_update(void *data, obs_data_t *settings)
 	}
 	audio_monitor->mute_stop_start = obs_data_get_bool(settings, "mute_stop_start");
 
+	// PulseAudio inputs can be monitored on the server without their audio going through OBS.
+	const char *direct_source = NULL;
+	obs_data_t *parent_settings = NULL;
+	if (parent && obs_data_get_bool(settings, "direct_monitor") &&
+	    strcmp(obs_source_get_unversioned_id(parent), "pulse_input_capture") == 0) {
+		parent_settings = obs_source_get_settings(parent);
+		direct_source = obs_data_get_string(parent_settings, "device_id");
+	}
+
 	int port = 0;
 	char *device_id = (char *)obs_data_get_string(settings, "device");
 	if (strcmp(device_id, "VBAN") == 0) {
 		device_id = (char *)obs_data_get_string(settings, "ip");
 		port = (int)obs_data_get_int(settings, "port");
 	}
-	if (!audio_monitor->monitor || strcmp(audio_monitor_get_device_id(audio_monitor->monitor), device_id) != 0) {
+	// The resampler is picked when the monitor starts, another quality takes a new monitor.
+	const int resampler_quality = (int)obs_data_get_int(settings, "resampler_quality");
+	// Without a delay the monitor filters of one source are fed its blocks and share their conversion, a delayed
+	// monitor is fed from its own delay line. The stream is read at start, turning the delay on or off takes a new monitor.
+	const void *stream = audio_monitor->delay ? NULL : parent;
+	if (!audio_monitor->monitor || strcmp(audio_monitor_get_device_id(audio_monitor->monitor), device_id) != 0 ||
+	    audio_monitor->resampler_quality != resampler_quality || audio_monitor->stream != stream) {
 		if (!port) {
 			struct updateFilterNameData d;
 			d.device_id = device_id;
 			d.device_name = NULL;
-			obs_enum_audio_monitoring_devices(updateFilterName, &d);
+			audio_monitor_enum_output_devices(updateFilterName, &d);
 			char *dn = (char *)obs_data_get_string(settings, "deviceName");
 			if (d.device_name) {
 				if (strcmp(dn, d.device_name) != 0) {
@@ -280,7 +334,7 @@ static void audio_monitor_update(void *data, obs_data_t *settings)
 			} else if (strlen(dn)) {
 				d.device_id = NULL;
 				d.device_name = dn;
-				obs_enum_audio_monitoring_devices(updateFilterId, &d);
+				audio_monitor_enum_output_devices(updateFilterId, &d);
 				if (d.device_id) {
 					if (strcmp(device_id, d.device_id) != 0) {
 						obs_data_set_string(settings, "device", d.device_id);
@@ -298,20 +352,49 @@ static void audio_monitor_update(void *data, obs_data_t *settings)
 		audio_monitor->monitor = NULL;
 		audio_monitor_destroy(old);
 		audio_monitor->monitor = audio_monitor_create(device_id, obs_source_get_name(audio_monitor->source), port);
+		audio_monitor->resampler_quality = resampler_quality;
+		audio_monitor_set_resampler_quality(audio_monitor->monitor, resampler_quality);
+		audio_monitor->stream = stream;
+		audio_monitor_set_stream(audio_monitor->monitor, stream);
+		audio_monitor_set_server_volume(audio_monitor->monitor, obs_data_get_bool(settings, "server_volume"));
+		audio_monitor_set_direct_source(audio_monitor->monitor, direct_source);
 		if (port) {
 			audio_monitor_set_format(audio_monitor->monitor, obs_data_get_int(settings, "format"));
 			audio_monitor_set_samples_per_sec(audio_monitor->monitor, obs_data_get_int(settings, "samples_per_sec"));
 		}
 		if (!audio_monitor->mute_stop_start || obs_source_enabled(audio_monitor->source))
 			audio_monitor_start(audio_monitor->monitor);
-	} else if (port) {
-		audio_monitor_set_format(audio_monitor->monitor, obs_data_get_int(settings, "format"));
-		audio_monitor_set_samples_per_sec(audio_monitor->monitor, obs_data_get_int(settings, "samples_per_sec"));
+	} else {
+		if (port) {
+			audio_monitor_set_format(audio_monitor->monitor, obs_data_get_int(settings, "format"));
+			audio_monitor_set_samples_per_sec(audio_monitor->monitor, obs_data_get_int(settings, "samples_per_sec"));
+		}
+		audio_monitor_set_server_volume(audio_monitor->monitor, obs_data_get_bool(settings, "server_volume"));
+		audio_monitor_set_direct_source(audio_monitor->monitor, direct_source);
 	}
 
 	audio_monitor_set_volume(audio_monitor->monitor, mul);
 	audio_monitor_set_mono(audio_monitor->monitor, obs_data_get_bool(settings, "mono"));
 	audio_monitor_set_balance(audio_monitor->monitor, (float)obs_data_get_double(settings, "balance"));
+	audio_monitor_set_channel_pair(audio_monitor->monitor, (int)obs_data_get_int(settings, "channel_pair"));
+	struct audio_dsp_eq_limiter_settings eq_limiter = {0};
+	if (obs_data_get_bool(settings, "eq")) {
+		eq_limiter.gain_db[0] = (float)obs_data_get_double(settings, "eq_low_gain");
+		eq_limiter.gain_db[1] = (float)obs_data_get_double(settings, "eq_mid_gain");
+		eq_limiter.gain_db[2] = (float)obs_data_get_double(settings, "eq_high_gain");
+	}
+	eq_limiter.frequency[0] = (float)obs_data_get_int(settings, "eq_low_frequency");
+	eq_limiter.frequency[1] = (float)obs_data_get_int(settings, "eq_mid_frequency");
+	eq_limiter.frequency[2] = (float)obs_data_get_int(settings, "eq_high_frequency");
+	eq_limiter.limiter = obs_data_get_bool(settings, "limiter");
+	eq_limiter.ceiling_db = (float)obs_data_get_double(settings, "limiter_ceiling");
+	eq_limiter.release_ms = (float)obs_data_get_double(settings, "limiter_release");
+	audio_monitor_set_eq_limiter(audio_monitor->monitor, &eq_limiter);
+	obs_data_release(parent_settings);
+	audio_monitor_set_max_latency(audio_monitor->monitor, obs_data_get_int(settings, "max_latency"),
+				      (int)obs_data_get_int(settings, "latency_policy"));
+	audio_monitor_set_latency_profile(audio_monitor->monitor, (int)obs_data_get_int(settings, "latency_profile"),
+					  obs_data_get_int(settings, "buffer_latency"));
 
 	struct calldata cd;
 	uint8_t stack[128];
@@ -350,54 +433,47 @@ static void audio_monitor_filter_destroy(void *data)
 		audio_monitor_destroy(audio_monitor->monitor);
 		audio_monitor->monitor = NULL;
 	}
-	while (audio_monitor->audio_buffer.size) {
-		struct obs_audio_data cached;
-		deque_pop_front(&audio_monitor->audio_buffer, &cached, sizeof(cached));
-		for (size_t i = 0; i < MAX_AV_PLANES; i++)
-			bfree(cached.data[i]);
-	}
-	deque_free(&audio_monitor->audio_buffer);
+	audio_monitor_delay_free(audio_monitor);
 	bfree(audio_monitor);
 }
 
 struct obs_audio_data *audio_monitor_filter_audio(void *data, struct obs_audio_data *audio)
 {
 	struct audio_monitor_context *audio_monitor = data;
-	if (audio_monitor->delay) {
-		struct obs_audio_data cached = *audio;
-		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-			if (!audio->data[i])
-				break;
-
-			cached.data[i] = bmemdup(audio->data[i], audio->frames * sizeof(float));
-		}
-		deque_push_back(&audio_monitor->audio_buffer, &cached, sizeof(cached));
-		deque_peek_front(&audio_monitor->audio_buffer, &cached, sizeof(cached));
-		uint64_t diff = cached.timestamp > audio->timestamp ? cached.timestamp - audio->timestamp
-								    : audio->timestamp - cached.timestamp;
-		while (audio_monitor->audio_buffer.size > sizeof(cached) && diff >= (uint64_t)audio_monitor->delay * 1000000) {
-
-			deque_pop_front(&audio_monitor->audio_buffer, NULL, sizeof(cached));
-
-			audio_monitor_audio(audio_monitor->monitor, &cached);
-
-			for (size_t i = 0; i < MAX_AV_PLANES; i++)
-				bfree(cached.data[i]);
-
-			deque_peek_front(&audio_monitor->audio_buffer, &cached, sizeof(cached));
-			diff = cached.timestamp > audio->timestamp ? cached.timestamp - audio->timestamp
-								   : audio->timestamp - cached.timestamp;
-		}
-	} else {
+	if (!audio_monitor->delay) {
 		if (audio_monitor->monitor)
 			audio_monitor_audio(audio_monitor->monitor, audio);
-		while (audio_monitor->audio_buffer.size) {
-			struct obs_audio_data cached;
-			deque_pop_front(&audio_monitor->audio_buffer, &cached, sizeof(cached));
-			for (size_t i = 0; i < MAX_AV_PLANES; i++)
-				bfree(cached.data[i]);
-		}
+		if (audio_monitor->delay_allocated)
+			audio_monitor_delay_free(audio_monitor);
+		return audio;
+	}
+
+	size_t channels = 0;
+	while (channels < MAX_AV_PLANES && audio->data[channels])
+		channels++;
+	if (audio_monitor->delay_allocated != audio_monitor->delay || audio_monitor->delay_channels != channels ||
+	    audio_monitor->delay_block_frames < audio->frames)
+		audio_monitor_delay_alloc(audio_monitor, audio_monitor->delay, channels, audio->frames);
+
+	const size_t bytes = audio->frames * sizeof(float);
+	for (size_t i = 0; i < channels; i++)
+		audio_ring_write(&audio_monitor->delay_ring[i], audio->data[i], bytes);
+
+	// Hold back at least delay_frames, the block that comes out is as long as the one that went in.
+	if (!channels ||
+	    audio_ring_size(&audio_monitor->delay_ring[0]) < (audio_monitor->delay_frames + audio->frames) * sizeof(float))
+		return audio;
+
+	struct obs_audio_data delayed = *audio;
+	for (size_t i = 0; i < channels; i++) {
+		float *plane = audio_monitor->delay_block + i * audio_monitor->delay_block_frames;
+		audio_ring_read(&audio_monitor->delay_ring[i], plane, bytes);
+		delayed.data[i] = (uint8_t *)plane;
 	}
+	const uint64_t delay_ns = (uint64_t)audio_monitor->delay * 1000000;
+	delayed.timestamp = audio->timestamp > delay_ns ? audio->timestamp - delay_ns : 0;
+	if (audio_monitor->monitor)
+		audio_monitor_audio(audio_monitor->monitor, &delayed);
 	return audio;
 }
 
@@ -428,6 +504,16 @@ bool audio_monitor_device_changed(obs_properties_t *props, obs_property_t *prope
 	return true;
 }
 
+#ifdef AUDIO_MONITOR_PULSE
+static bool audio_monitor_latency_profile_changed(obs_properties_t *props, obs_property_t *property, obs_data_t *settings)
+{
+	UNUSED_PARAMETER(property);
+	obs_property_set_visible(obs_properties_get(props, "buffer_latency"),
+				 obs_data_get_int(settings, "latency_profile") == LATENCY_PROFILE_CUSTOM);
+	return true;
+}
+#endif
+
 static obs_properties_t *audio_monitor_properties(void *data)
 {
 	struct audio_monitor_context *audio_monitor = data;
@@ -438,7 +524,7 @@ static obs_properties_t *audio_monitor_properties(void *data)
 #ifdef WIN32
 	obs_property_list_add_string(p, obs_module_text("VBAN"), "VBAN");
 #endif
-	obs_enum_audio_monitoring_devices(add_monitoring_device, p);
+	audio_monitor_enum_output_devices(add_monitoring_device, p);
 	obs_data_t *settings = obs_source_get_settings(audio_monitor->source);
 	if (settings) {
 		const char *device_id = obs_data_get_string(settings, "device");
@@ -472,6 +558,42 @@ static obs_properties_t *audio_monitor_properties(void *data)
 	obs_properties_add_bool(ppts, "linked", obs_module_text("Linked"));
 	obs_properties_add_bool(ppts, "mono", obs_module_text("Mono"));
 	obs_properties_add_float_slider(ppts, "balance", obs_module_text("Balance"), -1.0, 1.0, 0.01);
+	p = obs_properties_add_list(ppts, "channel_pair", obs_module_text("ChannelPair"), OBS_COMBO_TYPE_LIST,
+				    OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(p, obs_module_text("All"), 0);
+	obs_property_list_add_int(p, obs_module_text("ChannelPair.12"), 1);
+	obs_property_list_add_int(p, obs_module_text("ChannelPair.34"), 2);
+	obs_property_list_add_int(p, obs_module_text("ChannelPair.56"), 3);
+	obs_property_list_add_int(p, obs_module_text("ChannelPair.78"), 4);
+	p = obs_properties_add_list(ppts, "resampler_quality", obs_module_text("ResamplerQuality"), OBS_COMBO_TYPE_LIST,
+				    OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(p, obs_module_text("ResamplerQuality.Default"), AUDIO_DSP_RESAMPLER_LIBOBS);
+	obs_property_list_add_int(p, obs_module_text("ResamplerQuality.Fast"), AUDIO_DSP_RESAMPLER_FAST);
+	obs_property_list_add_int(p, obs_module_text("ResamplerQuality.Balanced"), AUDIO_DSP_RESAMPLER_BALANCED);
+	obs_property_list_add_int(p, obs_module_text("ResamplerQuality.Mastering"), AUDIO_DSP_RESAMPLER_MASTERING);
+
+	obs_properties_t *eq = obs_properties_create();
+	p = obs_properties_add_float_slider(eq, "eq_low_gain", obs_module_text("Eq.Low"), -12.0, 12.0, 0.5);
+	obs_property_float_set_suffix(p, "dB");
+	p = obs_properties_add_int_slider(eq, "eq_low_frequency", obs_module_text("Eq.LowFrequency"), 20, 1000, 10);
+	obs_property_int_set_suffix(p, "Hz");
+	p = obs_properties_add_float_slider(eq, "eq_mid_gain", obs_module_text("Eq.Mid"), -12.0, 12.0, 0.5);
+	obs_property_float_set_suffix(p, "dB");
+	p = obs_properties_add_int_slider(eq, "eq_mid_frequency", obs_module_text("Eq.MidFrequency"), 200, 8000, 10);
+	obs_property_int_set_suffix(p, "Hz");
+	p = obs_properties_add_float_slider(eq, "eq_high_gain", obs_module_text("Eq.High"), -12.0, 12.0, 0.5);
+	obs_property_float_set_suffix(p, "dB");
+	p = obs_properties_add_int_slider(eq, "eq_high_frequency", obs_module_text("Eq.HighFrequency"), 1000, 20000, 100);
+	obs_property_int_set_suffix(p, "Hz");
+	obs_properties_add_group(ppts, "eq", obs_module_text("Eq"), OBS_GROUP_CHECKABLE, eq);
+
+	obs_properties_t *limiter = obs_properties_create();
+	p = obs_properties_add_float_slider(limiter, "limiter_ceiling", obs_module_text("Limiter.Ceiling"), -24.0, 0.0, 0.1);
+	obs_property_float_set_suffix(p, "dB");
+	p = obs_properties_add_float_slider(limiter, "limiter_release", obs_module_text("Limiter.Release"), 10.0, 1000.0, 1.0);
+	obs_property_float_set_suffix(p, "ms");
+	obs_properties_add_group(ppts, "limiter", obs_module_text("Limiter"), OBS_GROUP_CHECKABLE, limiter);
+
 	p = obs_properties_add_list(ppts, "mute", obs_module_text("Mute"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
 	obs_property_list_add_int(p, obs_module_text("Never"), MUTE_NEVER);
 	obs_property_list_add_int(p, obs_module_text("NotActiveOutput"), MUTE_NOT_ACTIVE);
@@ -482,6 +604,39 @@ static obs_properties_t *audio_monitor_properties(void *data)
 
 	p = obs_properties_add_int(ppts, "delay", obs_module_text("Delay"), 0, 10000, 100);
 	obs_property_int_set_suffix(p, "ms");
+#if !defined(WIN32) && !defined(__APPLE__)
+	p = obs_properties_add_int(ppts, "max_latency", obs_module_text("MaxLatency"), 0, 2000, 10);
+	obs_property_int_set_suffix(p, "ms");
+	p = obs_properties_add_list(ppts, "latency_policy", obs_module_text("LatencyPolicy"), OBS_COMBO_TYPE_LIST,
+				    OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(p, obs_module_text("LatencyPolicy.DropOldest"), LATENCY_POLICY_DROP_OLDEST);
+	obs_property_list_add_int(p, obs_module_text("LatencyPolicy.Compress"), LATENCY_POLICY_COMPRESS);
+	obs_property_list_add_int(p, obs_module_text("LatencyPolicy.Resync"), LATENCY_POLICY_RESYNC);
+#ifdef AUDIO_MONITOR_PULSE
+	p = obs_properties_add_list(ppts, "latency_profile", obs_module_text("LatencyProfile"), OBS_COMBO_TYPE_LIST,
+				    OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(p, obs_module_text("LatencyProfile.Auto"), LATENCY_PROFILE_AUTO);
+	obs_property_list_add_int(p, obs_module_text("LatencyProfile.UltraLow"), LATENCY_PROFILE_ULTRA_LOW);
+	obs_property_list_add_int(p, obs_module_text("LatencyProfile.Low"), LATENCY_PROFILE_LOW);
+	obs_property_list_add_int(p, obs_module_text("LatencyProfile.Safe"), LATENCY_PROFILE_SAFE);
+	obs_property_list_add_int(p, obs_module_text("LatencyProfile.Custom"), LATENCY_PROFILE_CUSTOM);
+	obs_property_set_modified_callback(p, audio_monitor_latency_profile_changed);
+	p = obs_properties_add_int(ppts, "buffer_latency", obs_module_text("BufferLatency"), 5, 500, 1);
+	obs_property_int_set_suffix(p, "ms");
+	obs_properties_add_bool(ppts, "server_volume", obs_module_text("ServerVolume"));
+	obs_properties_add_bool(ppts, "direct_monitor", obs_module_text("DirectMonitor"));
+#endif
+	if (audio_monitor->monitor) {
+		char discarded[128];
+		snprintf(discarded, sizeof(discarded), "%s: %" PRIu64 " ms", obs_module_text("Discarded"),
+			 audio_monitor_get_discarded_ms(audio_monitor->monitor));
+		obs_properties_add_text(ppts, "discarded", discarded, OBS_TEXT_INFO);
+		char latency[128];
+		snprintf(latency, sizeof(latency), "%s: %" PRIu64 " ms", obs_module_text("AchievedLatency"),
+			 audio_monitor_get_latency_ms(audio_monitor->monitor));
+		obs_properties_add_text(ppts, "achieved_latency", latency, OBS_TEXT_INFO);
+	}
+#endif
 	obs_properties_add_text(ppts, "ip", obs_module_text("Ip"), OBS_TEXT_DEFAULT);
 	obs_properties_add_int(ppts, "port", obs_module_text("Port"), 1, 32767, 1);
 	p = obs_properties_add_list(ppts, "format", obs_module_text("Format"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
@@ -530,7 +685,16 @@ void audio_monitor_defaults(obs_data_t *settings)
 	obs_data_set_default_double(settings, "volume", 100.0);
 	obs_data_set_default_string(settings, "device", "default");
 	obs_data_set_default_int(settings, "port", 6980);
+	obs_data_set_default_int(settings, "max_latency", 200);
+	obs_data_set_default_int(settings, "latency_policy", LATENCY_POLICY_COMPRESS);
+	obs_data_set_default_int(settings, "latency_profile", LATENCY_PROFILE_AUTO);
+	obs_data_set_default_int(settings, "buffer_latency", 25);
 	obs_data_set_default_int(settings, "format", AUDIO_FORMAT_FLOAT);
+	obs_data_set_default_int(settings, "eq_low_frequency", 150);
+	obs_data_set_default_int(settings, "eq_mid_frequency", 2500);
+	obs_data_set_default_int(settings, "eq_high_frequency", 8000);
+	obs_data_set_default_double(settings, "limiter_ceiling", -1.0);
+	obs_data_set_default_double(settings, "limiter_release", 100.0);
 	obs_data_set_default_int(settings, "samples_per_sec", audio_output_get_info(obs_get_audio())->samples_per_sec);
 }
 
@@ -551,13 +715,7 @@ void audio_monitor_filter_remove(void *data, obs_source_t *source)
 		audio_monitor_destroy(audio_monitor->monitor);
 		audio_monitor->monitor = NULL;
 	}
-	while (audio_monitor->audio_buffer.size) {
-		struct obs_audio_data cached;
-		deque_pop_front(&audio_monitor->audio_buffer, &cached, sizeof(cached));
-		for (size_t i = 0; i < MAX_AV_PLANES; i++)
-			bfree(cached.data[i]);
-	}
-	deque_free(&audio_monitor->audio_buffer);
+	audio_monitor_delay_free(audio_monitor);
 }
 
 bool audio_monitor_enable_hotkey(void *data, obs_hotkey_pair_id id, obs_hotkey_t *hotkey, bool pressed)
@@ -641,9 +799,12 @@ OBS_MODULE_USE_DEFAULT_LOCALE("media-controls", "en-US")
 extern void load_audio_monitor_dock();
 bool obs_module_load()
 {
-	blog(LOG_INFO, "[Audio Monitor] loaded version %s", PROJECT_VERSION);
+	const uint64_t start = os_gettime_ns();
+	audio_dsp_init();
 	obs_register_source(&audio_monitor_filter_info);
 	load_audio_monitor_dock();
+	blog(LOG_INFO, "[Audio Monitor] loaded version %s in %.2f ms", PROJECT_VERSION,
+	     (double)(os_gettime_ns() - start) / 1000000.0);
 	return true;
 }
 
@@ -3,18 +3,57 @@
 #ifdef __cplusplus
 extern "C" {
 #endif
+
+#define LATENCY_POLICY_DROP_OLDEST 0
+#define LATENCY_POLICY_COMPRESS 1
+#define LATENCY_POLICY_RESYNC 2
+
+#define LATENCY_PROFILE_AUTO 0
+#define LATENCY_PROFILE_ULTRA_LOW 1
+#define LATENCY_PROFILE_LOW 2
+#define LATENCY_PROFILE_SAFE 3
+#define LATENCY_PROFILE_CUSTOM 4
+
 struct audio_monitor;
+struct audio_dsp_eq_limiter_settings;
 void audio_monitor_stop(struct audio_monitor *audio_monitor);
 void audio_monitor_start(struct audio_monitor *audio_monitor);
 void audio_monitor_audio(void *data, struct obs_audio_data *audio);
 void audio_monitor_set_volume(struct audio_monitor *audio_monitor, float volume);
 void audio_monitor_set_balance(struct audio_monitor *audio_monitor, float balance);
+void audio_monitor_set_server_volume(struct audio_monitor *audio_monitor, bool server_volume);
+void audio_monitor_set_direct_source(struct audio_monitor *audio_monitor, const char *source);
 void audio_monitor_set_mono(struct audio_monitor *audio_monitor, bool mono);
+void audio_monitor_set_channel_pair(struct audio_monitor *audio_monitor, int channel_pair);
+/* monitors started with the same stream are fed the same blocks and share their conversion */
+void audio_monitor_set_stream(struct audio_monitor *audio_monitor, const void *stream);
+/* one of audio_dsp_resampler_quality, takes effect when the monitor starts */
+void audio_monitor_set_resampler_quality(struct audio_monitor *audio_monitor, int quality);
+/* monitor only EQ and limiter, the stream mix is not touched */
+void audio_monitor_set_eq_limiter(struct audio_monitor *audio_monitor, const struct audio_dsp_eq_limiter_settings *settings);
 void audio_monitor_set_format(struct audio_monitor *audio_monitor, enum audio_format format);
 void audio_monitor_set_samples_per_sec(struct audio_monitor *audio_monitor, long long samples_per_sec);
+void audio_monitor_set_max_latency(struct audio_monitor *audio_monitor, long long max_latency, int policy);
+uint64_t audio_monitor_get_discarded_ms(struct audio_monitor *audio_monitor);
+void audio_monitor_set_latency_profile(struct audio_monitor *audio_monitor, int profile, long long custom_ms);
+uint64_t audio_monitor_get_latency_ms(struct audio_monitor *audio_monitor);
 struct audio_monitor *audio_monitor_create(const char *device_id, const char *source_name, int port);
 void audio_monitor_destroy(struct audio_monitor *audio_monitor);
 const char *audio_monitor_get_device_id(struct audio_monitor *audio_monitor);
+#ifdef AUDIO_MONITOR_ENUM_DEVICES
+/* for backends whose devices OBS does not list itself */
+void audio_monitor_enum_devices(bool (*cb)(void *data, const char *name, const char *id), void *data);
+#endif
+
+/* the devices the backend can open, the ones OBS lists belong to another sound system when the backend lists its own */
+static inline void audio_monitor_enum_output_devices(bool (*cb)(void *data, const char *name, const char *id), void *data)
+{
+#ifdef AUDIO_MONITOR_ENUM_DEVICES
+	audio_monitor_enum_devices(cb, data);
+#else
+	obs_enum_audio_monitoring_devices(cb, data);
+#endif
+}
 bool updateFilterName(void *data, const char *name, const char *id);
 bool updateFilterId(void *data, const char *name, const char *id);
 
@@ -0,0 +1,440 @@
+#include "audio-monitor-jack.h"
+#include "audio-monitor-filter.h"
+#include "audio-monitor-ring.h"
+#include <obs.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#include <util/dstr.h>
+#include <media-io/audio-resampler.h>
+
+/* frames processed per pass of the process callback, so the scratch buffer never has to grow */
+#define MONITOR_JACK_CHUNK_FRAMES 1024
+
+struct audio_monitor {
+	jack_client_t *client;
+	jack_port_t *ports[MAX_AUDIO_CHANNELS];
+	uint_fast32_t samples_per_sec;
+	uint_fast32_t bytes_per_frame;
+
+	uint_fast8_t channels;
+
+	/* interleaved float at the rate of the JACK server, resampled but not yet processed */
+	struct audio_ring ring;
+	/* scratch for one chunk in the process callback */
+	float *chunk;
+	volatile long xruns;
+	/* frames per JACK period, kept current by the buffer size callback */
+	volatile long period_frames;
+
+	struct audio_dsp_resampler *resampler;
+	/* monitors of the same stream share the conversion of each block */
+	const void *shared_stream;
+	/* audio_dsp_resampler_quality used from the next start */
+	int resampler_quality;
+	float volume;
+	bool mono;
+	float balance;
+	/* only this pair of channels is played when above 0 */
+	int channel_pair;
+	/* volume, mono, balance and channel pair as a channel matrix, only touched by the thread that processes audio */
+	struct audio_dsp_matrix matrix;
+	/* monitor only EQ and limiter, built from the settings by the thread that processes audio */
+	struct audio_dsp_eq_limiter_settings eq_limiter_settings;
+	struct audio_dsp_eq_limiter eq_limiter;
+	pthread_mutex_t mutex;
+	char *device_id;
+	char *source_name;
+
+	/* set once the client is active, the audio thread drops audio until then */
+	volatile bool ready;
+
+	/* latency ceiling of the ring, its policy and the audio it discarded */
+	struct monitor_latency latency;
+};
+
+/* Device ids are JACK clients that have input ports, "default" is the physical playback ports */
+void audio_monitor_enum_devices(bool (*cb)(void *data, const char *name, const char *id), void *data)
+{
+	jack_client_t *client = jack_client_open("obs-audio-monitor", JackNoStartServer, NULL);
+	if (!client)
+		return;
+
+	const char **ports = jack_get_ports(client, NULL, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput);
+	struct dstr last = {0};
+	for (size_t i = 0; ports && ports[i]; i++) {
+		const char *sep = strchr(ports[i], ':');
+		if (!sep)
+			continue;
+		// Ports are grouped by client, only report each client once.
+		if (last.len == (size_t)(sep - ports[i]) && strncmp(last.array, ports[i], last.len) == 0)
+			continue;
+		dstr_ncopy(&last, ports[i], sep - ports[i]);
+		if (!cb(data, last.array, last.array))
+			break;
+	}
+	dstr_free(&last);
+	if (ports)
+		jack_free(ports);
+
+	jack_client_close(client);
+}
+
+/* Runs on the JACK RT thread, so it must not block or allocate */
+static int monitor_jack_process(jack_nframes_t nframes, void *arg)
+{
+	struct audio_monitor *data = arg;
+	const uint_fast8_t channels = data->channels;
+	float *out[MAX_AUDIO_CHANNELS];
+	for (uint_fast8_t channel = 0; channel < channels; channel++)
+		out[channel] = jack_port_get_buffer(data->ports[channel], nframes);
+
+	for (jack_nframes_t done = 0; done < nframes;) {
+		jack_nframes_t frames = nframes - done;
+		if (frames > MONITOR_JACK_CHUNK_FRAMES)
+			frames = MONITOR_JACK_CHUNK_FRAMES;
+
+		// Pad with silence when the audio thread has not delivered enough data yet.
+		const size_t size = frames * data->bytes_per_frame;
+		const size_t read = monitor_ring_read(&data->ring, &data->latency, (uint32_t)data->samples_per_sec,
+						      (uint8_t *)data->chunk, size);
+		if (read < size)
+			memset((uint8_t *)data->chunk + read, 0, size - read);
+
+		// Volume, mono and balance are applied here so changes are heard within one period.
+		audio_dsp_matrix_update(&data->matrix, data->channels, data->volume, data->mono, data->balance, data->channel_pair);
+		audio_dsp_apply(&data->matrix, data->chunk, data->chunk, frames);
+		audio_dsp_eq_limiter_update(&data->eq_limiter, &data->eq_limiter_settings, data->channels,
+					    (uint32_t)data->samples_per_sec);
+		audio_dsp_eq_limiter_process(&data->eq_limiter, data->chunk, frames);
+
+		for (jack_nframes_t frame = 0; frame < frames; frame++) {
+			for (uint_fast8_t channel = 0; channel < channels; channel++)
+				out[channel][done + frame] = data->chunk[frame * channels + channel];
+		}
+		done += frames;
+	}
+	return 0;
+}
+
+static int monitor_jack_xrun(void *arg)
+{
+	struct audio_monitor *data = arg;
+	os_atomic_inc_long(&data->xruns);
+	return 0;
+}
+
+static int monitor_jack_buffer_size(jack_nframes_t nframes, void *arg)
+{
+	struct audio_monitor *data = arg;
+	os_atomic_set_long(&data->period_frames, (long)nframes);
+	return 0;
+}
+
+static void monitor_jack_shutdown(void *arg)
+{
+	struct audio_monitor *data = arg;
+	os_atomic_set_bool(&data->ready, false);
+	blog(LOG_WARNING, "JACK server shut down, monitoring in '%s' stopped", data->device_id);
+}
+
+/* Connects the output ports to the input ports of the device in order */
+static void monitor_jack_connect(struct audio_monitor *audio_monitor)
+{
+	const char **ports;
+	if (strcmp(audio_monitor->device_id, "default") == 0) {
+		ports = jack_get_ports(audio_monitor->client, NULL, JACK_DEFAULT_AUDIO_TYPE, JackPortIsPhysical | JackPortIsInput);
+	} else {
+		struct dstr pattern = {0};
+		dstr_printf(&pattern, "^%s:", audio_monitor->device_id);
+		ports = jack_get_ports(audio_monitor->client, pattern.array, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput);
+		dstr_free(&pattern);
+	}
+	if (!ports) {
+		blog(LOG_WARNING, "No JACK input ports found for '%s'", audio_monitor->device_id);
+		return;
+	}
+
+	for (uint_fast8_t channel = 0; channel < audio_monitor->channels && ports[channel]; channel++) {
+		if (jack_connect(audio_monitor->client, jack_port_name(audio_monitor->ports[channel]), ports[channel]) != 0)
+			blog(LOG_WARNING, "Unable to connect to JACK port '%s'", ports[channel]);
+	}
+	jack_free(ports);
+}
+
+void audio_monitor_stop(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor)
+		return;
+
+	// Keep the audio thread out, closing the client waits for the process callback.
+	os_atomic_set_bool(&audio_monitor->ready, false);
+	pthread_mutex_lock(&audio_monitor->mutex);
+
+	if (audio_monitor->client) {
+		jack_deactivate(audio_monitor->client);
+		jack_client_close(audio_monitor->client);
+		audio_monitor->client = NULL;
+		memset(audio_monitor->ports, 0, sizeof(audio_monitor->ports));
+
+		blog(LOG_INFO, "Stopped Monitoring in '%s', %ld xruns, %" PRIu64 " ms of audio discarded to keep latency bounded",
+		     audio_monitor->device_id, os_atomic_load_long(&audio_monitor->xruns),
+		     audio_monitor_get_discarded_ms(audio_monitor));
+	}
+
+	audio_ring_free(&audio_monitor->ring);
+	bfree(audio_monitor->chunk);
+	audio_monitor->chunk = NULL;
+	monitor_latency_stop(&audio_monitor->latency);
+	audio_dsp_resampler_destroy(audio_monitor->resampler);
+	audio_monitor->resampler = NULL;
+	audio_dsp_eq_limiter_reset(&audio_monitor->eq_limiter);
+
+	pthread_mutex_unlock(&audio_monitor->mutex);
+}
+
+void audio_monitor_start(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor)
+		return;
+
+	audio_monitor_stop(audio_monitor);
+	pthread_mutex_lock(&audio_monitor->mutex);
+
+	// JACK refuses client names above its limit, the server makes duplicates unique.
+	struct dstr name = {0};
+	dstr_ncopy(&name, audio_monitor->source_name, (size_t)jack_client_name_size() - 1);
+	jack_status_t status;
+	audio_monitor->client = jack_client_open(name.array, JackNoStartServer, &status);
+	dstr_free(&name);
+	if (!audio_monitor->client) {
+		blog(LOG_ERROR, "Unable to connect to the JACK server (status 0x%x)", (unsigned int)status);
+		pthread_mutex_unlock(&audio_monitor->mutex);
+		return;
+	}
+
+	const struct audio_output_info *info = audio_output_get_info(obs_get_audio());
+	audio_monitor->samples_per_sec = jack_get_sample_rate(audio_monitor->client);
+	audio_monitor->channels = (uint_fast8_t)get_audio_channels(info->speakers);
+	audio_monitor->bytes_per_frame = audio_monitor->channels * sizeof(float);
+
+	// Bridges the OBS clock to the JACK clock, the layout stays the one of OBS.
+	struct resample_info from = {.samples_per_sec = info->samples_per_sec,
+				     .speakers = info->speakers,
+				     .format = AUDIO_FORMAT_FLOAT_PLANAR};
+	struct resample_info to = {.samples_per_sec = (uint32_t)audio_monitor->samples_per_sec,
+				   .speakers = info->speakers,
+				   .format = AUDIO_FORMAT_FLOAT};
+
+	audio_monitor->resampler = audio_dsp_resampler_create(&to, &from, audio_monitor->resampler_quality,
+							      audio_monitor->shared_stream);
+	if (!audio_monitor->resampler) {
+		blog(LOG_WARNING, "%s: %s", __FUNCTION__, "Failed to create resampler");
+		goto fail;
+	}
+
+	for (uint_fast8_t channel = 0; channel < audio_monitor->channels; channel++) {
+		char name[16];
+		snprintf(name, sizeof(name), "out_%d", (int)channel + 1);
+		audio_monitor->ports[channel] =
+			jack_port_register(audio_monitor->client, name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+		if (!audio_monitor->ports[channel]) {
+			blog(LOG_ERROR, "Unable to register JACK port '%s'", name);
+			goto fail;
+		}
+	}
+
+	audio_ring_init(&audio_monitor->ring, (size_t)audio_monitor->samples_per_sec * MONITOR_RING_USEC / 1000000,
+			audio_monitor->bytes_per_frame);
+	monitor_latency_start(&audio_monitor->latency, (size_t)audio_monitor->samples_per_sec * MONITOR_FADE_USEC / 1000000,
+			      audio_monitor->bytes_per_frame);
+	audio_monitor->chunk = bzalloc(MONITOR_JACK_CHUNK_FRAMES * audio_monitor->bytes_per_frame);
+	os_atomic_set_long(&audio_monitor->xruns, 0);
+	os_atomic_set_long(&audio_monitor->period_frames, (long)jack_get_buffer_size(audio_monitor->client));
+
+	jack_set_process_callback(audio_monitor->client, monitor_jack_process, audio_monitor);
+	jack_set_xrun_callback(audio_monitor->client, monitor_jack_xrun, audio_monitor);
+	jack_set_buffer_size_callback(audio_monitor->client, monitor_jack_buffer_size, audio_monitor);
+	jack_on_shutdown(audio_monitor->client, monitor_jack_shutdown, audio_monitor);
+
+	if (jack_activate(audio_monitor->client) != 0) {
+		blog(LOG_ERROR, "Unable to activate JACK client");
+		goto fail;
+	}
+	monitor_jack_connect(audio_monitor);
+
+	blog(LOG_INFO, "Started Monitoring in '%s' as '%s', %" PRIuFAST32 " Hz, %u frames per period", audio_monitor->device_id,
+	     jack_get_client_name(audio_monitor->client), audio_monitor->samples_per_sec,
+	     (unsigned int)jack_get_buffer_size(audio_monitor->client));
+
+	pthread_mutex_unlock(&audio_monitor->mutex);
+	os_atomic_set_bool(&audio_monitor->ready, true);
+	return;
+
+fail:
+	pthread_mutex_unlock(&audio_monitor->mutex);
+	audio_monitor_stop(audio_monitor);
+}
+
+void audio_monitor_audio(void *data, struct obs_audio_data *audio)
+{
+	struct audio_monitor *audio_monitor = data;
+	// Drop audio until the client is active.
+	if (!os_atomic_load_bool(&audio_monitor->ready))
+		return;
+	pthread_mutex_lock(&audio_monitor->mutex);
+	if (!os_atomic_load_bool(&audio_monitor->ready) || !audio_monitor->resampler) {
+		pthread_mutex_unlock(&audio_monitor->mutex);
+		return;
+	}
+
+	const uint8_t *resample_data[MAX_AV_PLANES];
+	uint32_t resample_frames;
+	uint64_t ts_offset;
+	bool success = audio_dsp_resampler_resample(audio_monitor->resampler, resample_data, &resample_frames, &ts_offset,
+						    (const uint8_t *const *)audio->data, (uint32_t)audio->frames, audio->timestamp);
+	if (!success) {
+		pthread_mutex_unlock(&audio_monitor->mutex);
+		return;
+	}
+
+	// Only hand the data over, the process callback does the rest on the JACK thread.
+	monitor_ring_write(&audio_monitor->ring, &audio_monitor->latency, NULL, NULL, (const float *)resample_data[0],
+			   resample_frames);
+	pthread_mutex_unlock(&audio_monitor->mutex);
+}
+
+void audio_monitor_set_volume(struct audio_monitor *audio_monitor, float volume)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->volume = volume;
+}
+
+void audio_monitor_set_mono(struct audio_monitor *audio_monitor, bool mono)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->mono = mono;
+}
+
+void audio_monitor_set_balance(struct audio_monitor *audio_monitor, float balance)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->balance = balance;
+}
+
+void audio_monitor_set_channel_pair(struct audio_monitor *audio_monitor, int channel_pair)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->channel_pair = channel_pair;
+}
+
+void audio_monitor_set_stream(struct audio_monitor *audio_monitor, const void *stream)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->shared_stream = stream;
+}
+
+void audio_monitor_set_resampler_quality(struct audio_monitor *audio_monitor, int quality)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->resampler_quality = quality;
+}
+
+void audio_monitor_set_eq_limiter(struct audio_monitor *audio_monitor, const struct audio_dsp_eq_limiter_settings *settings)
+{
+	if (!audio_monitor || !settings)
+		return;
+	audio_monitor->eq_limiter_settings = *settings;
+}
+
+struct audio_monitor *audio_monitor_create(const char *device_id, const char *source_name, int port)
+{
+	UNUSED_PARAMETER(port);
+	struct audio_monitor *audio_monitor = bzalloc(sizeof(struct audio_monitor));
+	audio_monitor->device_id = bstrdup(device_id);
+	audio_monitor->source_name = bstrdup(source_name);
+	monitor_latency_init(&audio_monitor->latency);
+	pthread_mutex_init(&audio_monitor->mutex, NULL);
+	return audio_monitor;
+}
+
+void audio_monitor_destroy(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor_stop(audio_monitor);
+	pthread_mutex_destroy(&audio_monitor->mutex);
+	bfree(audio_monitor->source_name);
+	bfree(audio_monitor->device_id);
+	bfree(audio_monitor);
+}
+
+const char *audio_monitor_get_device_id(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor)
+		return NULL;
+	return audio_monitor->device_id;
+}
+
+void audio_monitor_set_format(struct audio_monitor *audio_monitor, enum audio_format format)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(format);
+}
+
+void audio_monitor_set_samples_per_sec(struct audio_monitor *audio_monitor, long long samples_per_sec)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(samples_per_sec);
+}
+
+void audio_monitor_set_max_latency(struct audio_monitor *audio_monitor, long long max_latency, int policy)
+{
+	if (!audio_monitor)
+		return;
+	monitor_latency_set(&audio_monitor->latency, max_latency, policy);
+}
+
+uint64_t audio_monitor_get_discarded_ms(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor)
+		return 0;
+	return monitor_latency_get_discarded_ms(&audio_monitor->latency, (uint32_t)audio_monitor->samples_per_sec);
+}
+
+/* The JACK server owns the buffer size, so only the current period is reported */
+void audio_monitor_set_latency_profile(struct audio_monitor *audio_monitor, int profile, long long custom_ms)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(profile);
+	UNUSED_PARAMETER(custom_ms);
+}
+
+uint64_t audio_monitor_get_latency_ms(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor || !os_atomic_load_bool(&audio_monitor->ready) || !audio_monitor->samples_per_sec)
+		return 0;
+	pthread_mutex_lock(&audio_monitor->mutex);
+	const uint64_t processing_ns = audio_dsp_resampler_get_latency_ns(audio_monitor->resampler) +
+				       audio_dsp_eq_limiter_get_latency_ns(&audio_monitor->eq_limiter);
+	pthread_mutex_unlock(&audio_monitor->mutex);
+	return (uint64_t)os_atomic_load_long(&audio_monitor->period_frames) * 1000 / audio_monitor->samples_per_sec +
+	       processing_ns / 1000000;
+}
+
+void audio_monitor_set_server_volume(struct audio_monitor *audio_monitor, bool server_volume)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(server_volume);
+}
+
+void audio_monitor_set_direct_source(struct audio_monitor *audio_monitor, const char *source)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(source);
+}
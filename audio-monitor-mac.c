@@ -1,5 +1,6 @@
 
 #include "audio-monitor-mac.h"
+#include "audio-dsp.h"
 #include <AudioUnit/AudioUnit.h>
 #include <AudioToolbox/AudioQueue.h>
 #include <CoreFoundation/CFString.h>
@@ -33,10 +34,24 @@ struct audio_monitor {
 	volatile bool active;
 	bool paused;
     uint32_t channels;
-	audio_resampler_t *resampler;
+	struct audio_dsp_resampler *resampler;
+	/* monitors of the same stream share the conversion of each block */
+	const void *shared_stream;
+	/* audio_dsp_resampler_quality used from the next start */
+	int resampler_quality;
 	float volume;
 	bool mono;
 	float balance;
+	/* only this pair of channels is played when above 0 */
+	int channel_pair;
+	/* volume, mono, balance and channel pair as a channel matrix, only touched by the thread that processes audio */
+	struct audio_dsp_matrix matrix;
+	/* monitor only EQ and limiter, built from the settings by the thread
+	 * that processes audio */
+	struct audio_dsp_eq_limiter_settings eq_limiter_settings;
+	struct audio_dsp_eq_limiter eq_limiter;
+	float *processed;
+	size_t processed_size;
 	pthread_mutex_t mutex;
     char *device_id;
 };
@@ -102,10 +117,18 @@ void audio_monitor_stop(struct audio_monitor *audio_monitor){
 	if (audio_monitor->queue) {
 		AudioQueueDispose(audio_monitor->queue, true);
 	}
+	// The queue waits for its callbacks when disposed, the audio thread
+	// writes into processed under the mutex.
+	pthread_mutex_lock(&audio_monitor->mutex);
 	deque_free(&audio_monitor->empty_buffers);
 	deque_free(&audio_monitor->new_data);
-    audio_resampler_destroy(audio_monitor->resampler);
+	audio_dsp_resampler_destroy(audio_monitor->resampler);
 	audio_monitor->resampler = NULL;
+	audio_dsp_eq_limiter_reset(&audio_monitor->eq_limiter);
+	bfree(audio_monitor->processed);
+	audio_monitor->processed = NULL;
+	audio_monitor->processed_size = 0;
+	pthread_mutex_unlock(&audio_monitor->mutex);
 }
 
 void audio_monitor_start(struct audio_monitor *audio_monitor){
@@ -176,7 +199,9 @@ void audio_monitor_start(struct audio_monitor *audio_monitor){
 	struct resample_info to = {.samples_per_sec = info->samples_per_sec,
 				   .speakers = info->speakers,
 				   .format = AUDIO_FORMAT_FLOAT};
-	audio_monitor->resampler = audio_resampler_create(&to, &from);
+	audio_monitor->resampler = audio_dsp_resampler_create(
+		&to, &from, audio_monitor->resampler_quality,
+		audio_monitor->shared_stream);
 	if (!audio_monitor->resampler) {
 		pthread_mutex_unlock(&audio_monitor->mutex);
 		return;
@@ -205,55 +230,40 @@ void audio_monitor_audio(void *data, struct obs_audio_data *audio){
 	    pthread_mutex_trylock(&audio_monitor->mutex) != 0)
 		return;
 
-	uint8_t *resample_data[MAX_AV_PLANES];
+	const uint8_t *resample_data[MAX_AV_PLANES];
 	uint32_t resample_frames;
 	uint64_t ts_offset;
-	bool success = audio_resampler_resample(
+	bool success = audio_dsp_resampler_resample(
 		audio_monitor->resampler, resample_data, &resample_frames,
 		&ts_offset, (const uint8_t *const *)audio->data,
-		(uint32_t)audio->frames);
+		(uint32_t)audio->frames, audio->timestamp);
 	if (!success) {
 		pthread_mutex_unlock(&audio_monitor->mutex);
 		return;
 	}
-	/* apply volume */
-	float vol = audio_monitor->volume;
-	if (!close_float(vol, 1.0f, EPSILON)) {
-		register float *cur = (float *)resample_data[0];
-		register float *end =
-			cur + resample_frames * audio_monitor->channels;
-
-		while (cur < end)
-			*(cur++) *= vol;
-	}
-	/* apply mono */
-	if (audio_monitor->mono && audio_monitor->channels > 1) {
-		for (uint32_t frame = 0; frame < resample_frames; frame++) {
-			float avg = 0.0f;
-			for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-				avg += ((float *)resample_data[0])[frame * audio_monitor->channels + channel];
-			}
-			avg /= (float)audio_monitor->channels;
-			for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-				((float *)resample_data[0])[frame * audio_monitor->channels + channel] = avg;
-			}
-		}
-	}
-	/* apply balance */
-	float bal = (audio_monitor->balance + 1.0f) / 2.0f;
-	if (!close_float(bal, 0.5f, EPSILON) && audio_monitor->channels > 1) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				((float *)resample_data[0])[frame * audio_monitor->channels + 0] =
-					((float *)resample_data[0])[frame * audio_monitor->channels + 0] *
-					sinf((1.0f - bal) * (M_PI / 2.0f));
-				((float *)resample_data[0])[frame * audio_monitor->channels + 1] =
-					((float *)resample_data[0])[frame * audio_monitor->channels + 1] *
-					sinf(bal * (M_PI / 2.0f));
-			}
-	}
+	audio_dsp_matrix_update(&audio_monitor->matrix, audio_monitor->channels,
+				audio_monitor->volume, audio_monitor->mono,
+				audio_monitor->balance, audio_monitor->channel_pair);
+	audio_dsp_eq_limiter_update(
+		&audio_monitor->eq_limiter, &audio_monitor->eq_limiter_settings,
+		audio_monitor->channels,
+		audio_output_get_sample_rate(obs_get_audio()));
     uint32_t bytes =
 		sizeof(float) * audio_monitor->channels * resample_frames;
-	deque_push_back(&audio_monitor->new_data, resample_data[0], bytes);
+	// Other monitors can read the same resampled audio, the matrix
+	// leaves it as is and writes to its own buffer.
+	if (audio_monitor->processed_size < bytes) {
+		audio_monitor->processed =
+			brealloc(audio_monitor->processed, bytes);
+		audio_monitor->processed_size = bytes;
+	}
+	audio_dsp_apply(&audio_monitor->matrix,
+			(const float *)resample_data[0],
+			audio_monitor->processed, resample_frames);
+	audio_dsp_eq_limiter_process(&audio_monitor->eq_limiter,
+				     audio_monitor->processed, resample_frames);
+	deque_push_back(&audio_monitor->new_data, audio_monitor->processed,
+			bytes);
 	if (audio_monitor->new_data.size >= audio_monitor->wait_size) {
 		audio_monitor->wait_size = 0;
 
@@ -289,6 +299,31 @@ void audio_monitor_set_balance(struct audio_monitor *audio_monitor, float balanc
 	audio_monitor->balance = balance;
 }
 
+void audio_monitor_set_channel_pair(struct audio_monitor *audio_monitor, int channel_pair){
+	if (!audio_monitor)
+		return;
+	audio_monitor->channel_pair = channel_pair;
+}
+
+void audio_monitor_set_stream(struct audio_monitor *audio_monitor, const void *stream){
+	if (!audio_monitor)
+		return;
+	audio_monitor->shared_stream = stream;
+}
+
+void audio_monitor_set_resampler_quality(struct audio_monitor *audio_monitor, int quality){
+	if (!audio_monitor)
+		return;
+	audio_monitor->resampler_quality = quality;
+}
+
+void audio_monitor_set_eq_limiter(struct audio_monitor *audio_monitor,
+				  const struct audio_dsp_eq_limiter_settings *settings){
+	if (!audio_monitor || !settings)
+		return;
+	audio_monitor->eq_limiter_settings = *settings;
+}
+
 struct audio_monitor *audio_monitor_create(const char *device_id, const char* source_name, int port){
 	UNUSED_PARAMETER(source_name);
 	UNUSED_PARAMETER(port);
@@ -324,3 +359,44 @@ void audio_monitor_set_samples_per_sec(struct audio_monitor *audio_monitor,
 	UNUSED_PARAMETER(audio_monitor);
 	UNUSED_PARAMETER(samples_per_sec);
 }
+
+void audio_monitor_set_max_latency(struct audio_monitor *audio_monitor,
+				   long long max_latency, int policy){
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(max_latency);
+	UNUSED_PARAMETER(policy);
+}
+
+uint64_t audio_monitor_get_discarded_ms(struct audio_monitor *audio_monitor){
+	UNUSED_PARAMETER(audio_monitor);
+	return 0;
+}
+
+void audio_monitor_set_latency_profile(struct audio_monitor *audio_monitor, int profile, long long custom_ms){
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(profile);
+	UNUSED_PARAMETER(custom_ms);
+}
+
+uint64_t audio_monitor_get_latency_ms(struct audio_monitor *audio_monitor){
+	// Only the resampler and the limiter are known, the delay of the
+	// device is not.
+	if (!audio_monitor)
+		return 0;
+	pthread_mutex_lock(&audio_monitor->mutex);
+	const uint64_t processing_ns =
+		audio_dsp_resampler_get_latency_ns(audio_monitor->resampler) +
+		audio_dsp_eq_limiter_get_latency_ns(&audio_monitor->eq_limiter);
+	pthread_mutex_unlock(&audio_monitor->mutex);
+	return processing_ns / 1000000;
+}
+
+void audio_monitor_set_server_volume(struct audio_monitor *audio_monitor, bool server_volume){
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(server_volume);
+}
+
+void audio_monitor_set_direct_source(struct audio_monitor *audio_monitor, const char *source){
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(source);
+}
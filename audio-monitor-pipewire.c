@@ -0,0 +1,500 @@
+#include "audio-monitor-pipewire.h"
+#include "audio-monitor-filter.h"
+#include "audio-monitor-ring.h"
+#include <obs.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#include <media-io/audio-resampler.h>
+
+/* quantum asked from the graph, PipeWire picks the smallest one of all nodes */
+#define MONITOR_NODE_LATENCY_USEC 10000
+
+static uint_fast32_t pipewire_refs = 0;
+static pthread_mutex_t pipewire_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct pw_thread_loop *pipewire_loop = NULL;
+static struct pw_context *pipewire_context = NULL;
+static struct pw_core *pipewire_core = NULL;
+
+struct audio_monitor {
+	struct pw_stream *stream;
+	struct spa_hook stream_listener;
+	uint_fast32_t samples_per_sec;
+	uint_fast32_t bytes_per_frame;
+
+	uint_fast8_t channels;
+
+	/* interleaved float at the rate and channels of OBS, PipeWire converts to the sink */
+	struct audio_ring ring;
+
+	struct audio_dsp_resampler *resampler;
+	/* monitors of the same stream share the conversion of each block */
+	const void *shared_stream;
+	/* audio_dsp_resampler_quality used from the next start */
+	int resampler_quality;
+	float volume;
+	bool mono;
+	float balance;
+	/* only this pair of channels is played when above 0 */
+	int channel_pair;
+	/* volume, mono, balance and channel pair as a channel matrix, only touched by the thread that processes audio */
+	struct audio_dsp_matrix matrix;
+	/* monitor only EQ and limiter, built from the settings by the thread that processes audio */
+	struct audio_dsp_eq_limiter_settings eq_limiter_settings;
+	struct audio_dsp_eq_limiter eq_limiter;
+	pthread_mutex_t mutex;
+	char *device_id;
+	char *source_name;
+
+	/* set once the stream is connected, the audio thread drops audio until then */
+	volatile bool ready;
+
+	/* latency ceiling of the ring, its policy and the audio it discarded */
+	struct monitor_latency latency;
+};
+
+static void pipewire_lock()
+{
+	pw_thread_loop_lock(pipewire_loop);
+}
+
+static void pipewire_unlock()
+{
+	pw_thread_loop_unlock(pipewire_loop);
+}
+
+static bool pipewire_init()
+{
+	pthread_mutex_lock(&pipewire_mutex);
+
+	if (pipewire_refs == 0) {
+		pw_init(NULL, NULL);
+		pipewire_loop = pw_thread_loop_new("audio-monitor: pipewire", NULL);
+		pipewire_context = pw_context_new(pw_thread_loop_get_loop(pipewire_loop), NULL, 0);
+		pw_thread_loop_start(pipewire_loop);
+
+		pipewire_lock();
+		pipewire_core = pw_context_connect(pipewire_context, NULL, 0);
+		pipewire_unlock();
+
+		if (!pipewire_core)
+			blog(LOG_ERROR, "Unable to connect to PipeWire");
+		else
+			blog(LOG_INFO, "PipeWire library version: %s", pw_get_library_version());
+	}
+
+	pipewire_refs++;
+	const bool connected = pipewire_core != NULL;
+
+	pthread_mutex_unlock(&pipewire_mutex);
+	return connected;
+}
+
+static void pipewire_unref()
+{
+	pthread_mutex_lock(&pipewire_mutex);
+
+	if (--pipewire_refs == 0) {
+		pw_thread_loop_stop(pipewire_loop);
+		if (pipewire_core) {
+			pw_core_disconnect(pipewire_core);
+			pipewire_core = NULL;
+		}
+		pw_context_destroy(pipewire_context);
+		pipewire_context = NULL;
+		pw_thread_loop_destroy(pipewire_loop);
+		pipewire_loop = NULL;
+		pw_deinit();
+	}
+
+	pthread_mutex_unlock(&pipewire_mutex);
+}
+
+static void pipewire_channel_positions(enum speaker_layout layout, struct spa_audio_info_raw *info)
+{
+	switch (layout) {
+	case SPEAKERS_MONO:
+		info->position[0] = SPA_AUDIO_CHANNEL_MONO;
+		break;
+	case SPEAKERS_STEREO:
+		info->position[0] = SPA_AUDIO_CHANNEL_FL;
+		info->position[1] = SPA_AUDIO_CHANNEL_FR;
+		break;
+	case SPEAKERS_2POINT1:
+		info->position[0] = SPA_AUDIO_CHANNEL_FL;
+		info->position[1] = SPA_AUDIO_CHANNEL_FR;
+		info->position[2] = SPA_AUDIO_CHANNEL_LFE;
+		break;
+	case SPEAKERS_4POINT0:
+		info->position[0] = SPA_AUDIO_CHANNEL_FL;
+		info->position[1] = SPA_AUDIO_CHANNEL_FR;
+		info->position[2] = SPA_AUDIO_CHANNEL_FC;
+		info->position[3] = SPA_AUDIO_CHANNEL_RC;
+		break;
+	case SPEAKERS_4POINT1:
+		info->position[0] = SPA_AUDIO_CHANNEL_FL;
+		info->position[1] = SPA_AUDIO_CHANNEL_FR;
+		info->position[2] = SPA_AUDIO_CHANNEL_FC;
+		info->position[3] = SPA_AUDIO_CHANNEL_LFE;
+		info->position[4] = SPA_AUDIO_CHANNEL_RC;
+		break;
+	case SPEAKERS_5POINT1:
+		info->position[0] = SPA_AUDIO_CHANNEL_FL;
+		info->position[1] = SPA_AUDIO_CHANNEL_FR;
+		info->position[2] = SPA_AUDIO_CHANNEL_FC;
+		info->position[3] = SPA_AUDIO_CHANNEL_LFE;
+		info->position[4] = SPA_AUDIO_CHANNEL_RL;
+		info->position[5] = SPA_AUDIO_CHANNEL_RR;
+		break;
+	case SPEAKERS_7POINT1:
+		info->position[0] = SPA_AUDIO_CHANNEL_FL;
+		info->position[1] = SPA_AUDIO_CHANNEL_FR;
+		info->position[2] = SPA_AUDIO_CHANNEL_FC;
+		info->position[3] = SPA_AUDIO_CHANNEL_LFE;
+		info->position[4] = SPA_AUDIO_CHANNEL_RL;
+		info->position[5] = SPA_AUDIO_CHANNEL_RR;
+		info->position[6] = SPA_AUDIO_CHANNEL_SL;
+		info->position[7] = SPA_AUDIO_CHANNEL_SR;
+		break;
+	case SPEAKERS_UNKNOWN:
+	default:
+		for (uint32_t i = 0; i < info->channels; i++)
+			info->position[i] = SPA_AUDIO_CHANNEL_UNKNOWN;
+		break;
+	}
+}
+
+/* Runs on the PipeWire data thread, so it must not block or allocate */
+static void pipewire_stream_process(void *userdata)
+{
+	struct audio_monitor *data = userdata;
+	struct pw_buffer *b = pw_stream_dequeue_buffer(data->stream);
+	if (!b)
+		return;
+
+	struct spa_data *d = &b->buffer->datas[0];
+	if (!d->data) {
+		pw_stream_queue_buffer(data->stream, b);
+		return;
+	}
+
+	size_t frames = d->maxsize / data->bytes_per_frame;
+	if (b->requested && b->requested < frames)
+		frames = (size_t)b->requested;
+	const size_t size = frames * data->bytes_per_frame;
+
+	// Pad with silence when the audio thread has not delivered enough data yet.
+	const size_t read = monitor_ring_read(&data->ring, &data->latency, (uint32_t)data->samples_per_sec, d->data, size);
+	if (read < size)
+		memset((uint8_t *)d->data + read, 0, size - read);
+
+	d->chunk->offset = 0;
+	d->chunk->stride = (int32_t)data->bytes_per_frame;
+	d->chunk->size = (uint32_t)size;
+	pw_stream_queue_buffer(data->stream, b);
+}
+
+static void pipewire_stream_state_changed(void *userdata, enum pw_stream_state old, enum pw_stream_state state, const char *error)
+{
+	UNUSED_PARAMETER(old);
+	struct audio_monitor *data = userdata;
+	if (state == PW_STREAM_STATE_ERROR)
+		blog(LOG_ERROR, "Monitoring stream in '%s' failed: %s", data->device_id, error ? error : "unknown error");
+	else
+		blog(LOG_DEBUG, "Monitoring stream in '%s' is %s", data->device_id, pw_stream_state_as_string(state));
+}
+
+static const struct pw_stream_events pipewire_stream_events = {
+	.version = PW_VERSION_STREAM_EVENTS,
+	.state_changed = pipewire_stream_state_changed,
+	.process = pipewire_stream_process,
+};
+
+void audio_monitor_stop(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor)
+		return;
+
+	// Keep the audio thread out, the stream is only touched with the loop locked.
+	os_atomic_set_bool(&audio_monitor->ready, false);
+	pthread_mutex_lock(&audio_monitor->mutex);
+
+	if (audio_monitor->stream) {
+		/* Destroying the stream waits for a process callback that might still be running */
+		pipewire_lock();
+		pw_stream_destroy(audio_monitor->stream);
+		pipewire_unlock();
+		audio_monitor->stream = NULL;
+
+		blog(LOG_INFO, "Stopped Monitoring in '%s', %" PRIu64 " ms of audio discarded to keep latency bounded",
+		     audio_monitor->device_id, audio_monitor_get_discarded_ms(audio_monitor));
+		pipewire_unref();
+	}
+
+	audio_ring_free(&audio_monitor->ring);
+	monitor_latency_stop(&audio_monitor->latency);
+	audio_dsp_resampler_destroy(audio_monitor->resampler);
+	audio_monitor->resampler = NULL;
+	audio_dsp_eq_limiter_reset(&audio_monitor->eq_limiter);
+
+	pthread_mutex_unlock(&audio_monitor->mutex);
+}
+
+void audio_monitor_start(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor)
+		return;
+
+	audio_monitor_stop(audio_monitor);
+	pthread_mutex_lock(&audio_monitor->mutex);
+
+	if (!pipewire_init()) {
+		pipewire_unref();
+		pthread_mutex_unlock(&audio_monitor->mutex);
+		return;
+	}
+
+	const struct audio_output_info *info = audio_output_get_info(obs_get_audio());
+	audio_monitor->samples_per_sec = info->samples_per_sec;
+	audio_monitor->channels = (uint_fast8_t)get_audio_channels(info->speakers);
+	audio_monitor->bytes_per_frame = audio_monitor->channels * sizeof(float);
+
+	// PipeWire adapts rate and channels to the sink, only interleave here.
+	struct resample_info from = {.samples_per_sec = info->samples_per_sec,
+				     .speakers = info->speakers,
+				     .format = AUDIO_FORMAT_FLOAT_PLANAR};
+	struct resample_info to = {.samples_per_sec = info->samples_per_sec, .speakers = info->speakers, .format = AUDIO_FORMAT_FLOAT};
+
+	audio_monitor->resampler = audio_dsp_resampler_create(&to, &from, audio_monitor->resampler_quality,
+							      audio_monitor->shared_stream);
+	if (!audio_monitor->resampler) {
+		blog(LOG_WARNING, "%s: %s", __FUNCTION__, "Failed to create resampler");
+		pipewire_unref();
+		pthread_mutex_unlock(&audio_monitor->mutex);
+		return;
+	}
+
+	audio_ring_init(&audio_monitor->ring, (size_t)audio_monitor->samples_per_sec * MONITOR_RING_USEC / 1000000,
+			audio_monitor->bytes_per_frame);
+	monitor_latency_start(&audio_monitor->latency, (size_t)audio_monitor->samples_per_sec * MONITOR_FADE_USEC / 1000000,
+			      audio_monitor->bytes_per_frame);
+
+	struct pw_properties *props = pw_properties_new(PW_KEY_MEDIA_TYPE, "Audio", PW_KEY_MEDIA_CATEGORY, "Playback",
+							PW_KEY_MEDIA_ROLE, "Production", PW_KEY_APP_NAME, "OBS",
+							PW_KEY_APP_ICON_NAME, "obs", PW_KEY_NODE_DESCRIPTION,
+							audio_monitor->source_name, NULL);
+	pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%u/%u",
+			   (unsigned int)(audio_monitor->samples_per_sec * MONITOR_NODE_LATENCY_USEC / 1000000),
+			   (unsigned int)audio_monitor->samples_per_sec);
+	// Without a target the session manager routes to the default sink.
+	if (strcmp(audio_monitor->device_id, "default") != 0)
+		pw_properties_set(props, PW_KEY_TARGET_OBJECT, audio_monitor->device_id);
+
+	struct spa_audio_info_raw raw = {.format = SPA_AUDIO_FORMAT_F32,
+					 .rate = (uint32_t)audio_monitor->samples_per_sec,
+					 .channels = audio_monitor->channels};
+	pipewire_channel_positions(info->speakers, &raw);
+
+	uint8_t buffer[1024];
+	struct spa_pod_builder builder = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	const struct spa_pod *params[1];
+	params[0] = spa_format_audio_raw_build(&builder, SPA_PARAM_EnumFormat, &raw);
+
+	pipewire_lock();
+	audio_monitor->stream = pw_stream_new(pipewire_core, audio_monitor->source_name, props);
+	int ret = -1;
+	if (audio_monitor->stream) {
+		pw_stream_add_listener(audio_monitor->stream, &audio_monitor->stream_listener, &pipewire_stream_events,
+				       audio_monitor);
+		ret = pw_stream_connect(audio_monitor->stream, PW_DIRECTION_OUTPUT, PW_ID_ANY,
+					PW_STREAM_FLAG_AUTOCONNECT | PW_STREAM_FLAG_MAP_BUFFERS | PW_STREAM_FLAG_RT_PROCESS,
+					params, 1);
+	}
+	pipewire_unlock();
+
+	pthread_mutex_unlock(&audio_monitor->mutex);
+
+	if (ret < 0) {
+		blog(LOG_ERROR, "Unable to connect to stream");
+		// Stopping drops the reference when there is a stream to destroy.
+		const bool has_stream = audio_monitor->stream != NULL;
+		audio_monitor_stop(audio_monitor);
+		if (!has_stream)
+			pipewire_unref();
+		return;
+	}
+
+	blog(LOG_INFO, "Started Monitoring in '%s'", audio_monitor->device_id);
+
+	os_atomic_set_bool(&audio_monitor->ready, true);
+}
+
+void audio_monitor_audio(void *data, struct obs_audio_data *audio)
+{
+	struct audio_monitor *audio_monitor = data;
+	// Drop audio until the stream is connected.
+	if (!os_atomic_load_bool(&audio_monitor->ready))
+		return;
+	pthread_mutex_lock(&audio_monitor->mutex);
+	if (!os_atomic_load_bool(&audio_monitor->ready) || !audio_monitor->resampler) {
+		pthread_mutex_unlock(&audio_monitor->mutex);
+		return;
+	}
+
+	const uint8_t *resample_data[MAX_AV_PLANES];
+	uint32_t resample_frames;
+	uint64_t ts_offset;
+	bool success = audio_dsp_resampler_resample(audio_monitor->resampler, resample_data, &resample_frames, &ts_offset,
+						    (const uint8_t *const *)audio->data, (uint32_t)audio->frames, audio->timestamp);
+	if (!success) {
+		pthread_mutex_unlock(&audio_monitor->mutex);
+		return;
+	}
+
+	// Other monitors can read the same resampled audio, the matrix leaves it as is and writes straight into the ring.
+	// The process callback drains the ring on the data thread.
+	const float *samples = (const float *)resample_data[0];
+	audio_dsp_matrix_update(&audio_monitor->matrix, audio_monitor->channels, audio_monitor->volume, audio_monitor->mono,
+				audio_monitor->balance, audio_monitor->channel_pair);
+	audio_dsp_eq_limiter_update(&audio_monitor->eq_limiter, &audio_monitor->eq_limiter_settings, audio_monitor->channels,
+				    (uint32_t)audio_monitor->samples_per_sec);
+
+	monitor_ring_write(&audio_monitor->ring, &audio_monitor->latency, &audio_monitor->matrix, &audio_monitor->eq_limiter,
+			   samples, resample_frames);
+	pthread_mutex_unlock(&audio_monitor->mutex);
+}
+
+void audio_monitor_set_volume(struct audio_monitor *audio_monitor, float volume)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->volume = volume;
+}
+
+void audio_monitor_set_mono(struct audio_monitor *audio_monitor, bool mono)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->mono = mono;
+}
+
+void audio_monitor_set_balance(struct audio_monitor *audio_monitor, float balance)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->balance = balance;
+}
+
+void audio_monitor_set_channel_pair(struct audio_monitor *audio_monitor, int channel_pair)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->channel_pair = channel_pair;
+}
+
+void audio_monitor_set_stream(struct audio_monitor *audio_monitor, const void *stream)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->shared_stream = stream;
+}
+
+void audio_monitor_set_resampler_quality(struct audio_monitor *audio_monitor, int quality)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->resampler_quality = quality;
+}
+
+void audio_monitor_set_eq_limiter(struct audio_monitor *audio_monitor, const struct audio_dsp_eq_limiter_settings *settings)
+{
+	if (!audio_monitor || !settings)
+		return;
+	audio_monitor->eq_limiter_settings = *settings;
+}
+
+struct audio_monitor *audio_monitor_create(const char *device_id, const char *source_name, int port)
+{
+	UNUSED_PARAMETER(port);
+	struct audio_monitor *audio_monitor = bzalloc(sizeof(struct audio_monitor));
+	audio_monitor->device_id = bstrdup(device_id);
+	audio_monitor->source_name = bstrdup(source_name);
+	monitor_latency_init(&audio_monitor->latency);
+	pthread_mutex_init(&audio_monitor->mutex, NULL);
+	return audio_monitor;
+}
+
+void audio_monitor_destroy(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor_stop(audio_monitor);
+	pthread_mutex_destroy(&audio_monitor->mutex);
+	bfree(audio_monitor->source_name);
+	bfree(audio_monitor->device_id);
+	bfree(audio_monitor);
+}
+
+const char *audio_monitor_get_device_id(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor)
+		return NULL;
+	return audio_monitor->device_id;
+}
+
+void audio_monitor_set_format(struct audio_monitor *audio_monitor, enum audio_format format)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(format);
+}
+
+void audio_monitor_set_samples_per_sec(struct audio_monitor *audio_monitor, long long samples_per_sec)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(samples_per_sec);
+}
+
+void audio_monitor_set_max_latency(struct audio_monitor *audio_monitor, long long max_latency, int policy)
+{
+	if (!audio_monitor)
+		return;
+	monitor_latency_set(&audio_monitor->latency, max_latency, policy);
+}
+
+uint64_t audio_monitor_get_discarded_ms(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor)
+		return 0;
+	return monitor_latency_get_discarded_ms(&audio_monitor->latency, (uint32_t)audio_monitor->samples_per_sec);
+}
+
+/* The quantum is fixed through node.latency, the graph decides the rest */
+void audio_monitor_set_latency_profile(struct audio_monitor *audio_monitor, int profile, long long custom_ms)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(profile);
+	UNUSED_PARAMETER(custom_ms);
+}
+
+uint64_t audio_monitor_get_latency_ms(struct audio_monitor *audio_monitor)
+{
+	// Only the resampler and the limiter are known, the delay of the device is not.
+	if (!audio_monitor)
+		return 0;
+	pthread_mutex_lock(&audio_monitor->mutex);
+	const uint64_t processing_ns = audio_dsp_resampler_get_latency_ns(audio_monitor->resampler) +
+				       audio_dsp_eq_limiter_get_latency_ns(&audio_monitor->eq_limiter);
+	pthread_mutex_unlock(&audio_monitor->mutex);
+	return processing_ns / 1000000;
+}
+
+void audio_monitor_set_server_volume(struct audio_monitor *audio_monitor, bool server_volume)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(server_volume);
+}
+
+void audio_monitor_set_direct_source(struct audio_monitor *audio_monitor, const char *source)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(source);
+}
@@ -0,0 +1,45 @@
+#define PULSEAUDIO_API_IMPLEMENTATION
+#include "audio-monitor-pulse.h"
+#include <obs.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+struct pulseaudio_api pulseaudio_api;
+
+static pthread_mutex_t pulseaudio_api_mutex = PTHREAD_MUTEX_INITIALIZER;
+static void *pulseaudio_api_module = NULL;
+static bool pulseaudio_api_tried = false;
+
+bool pulseaudio_api_load(void)
+{
+	pthread_mutex_lock(&pulseaudio_api_mutex);
+	if (!pulseaudio_api_tried) {
+		pulseaudio_api_tried = true;
+
+		const uint64_t start = os_gettime_ns();
+		void *module = os_dlopen("libpulse.so.0");
+		bool complete = module != NULL;
+
+#define PULSEAUDIO_API_RESOLVE(func)                                                            \
+	if (complete && !(pulseaudio_api.func = (__typeof__(func) *)os_dlsym(module, #func))) { \
+		blog(LOG_WARNING, "[Audio Monitor] libpulse is missing %s", #func);             \
+		complete = false;                                                               \
+	}
+		PULSEAUDIO_API_FUNCS(PULSEAUDIO_API_RESOLVE)
+#undef PULSEAUDIO_API_RESOLVE
+
+		if (complete) {
+			pulseaudio_api_module = module;
+			blog(LOG_INFO, "[Audio Monitor] loaded libpulse in %.2f ms", (double)(os_gettime_ns() - start) / 1000000.0);
+		} else {
+			// Stay disabled for the rest of the session, a half resolved table is never used.
+			if (module)
+				os_dlclose(module);
+			memset(&pulseaudio_api, 0, sizeof(pulseaudio_api));
+			blog(LOG_WARNING, "[Audio Monitor] libpulse is not available, monitoring is disabled");
+		}
+	}
+	const bool loaded = pulseaudio_api_module != NULL;
+	pthread_mutex_unlock(&pulseaudio_api_mutex);
+	return loaded;
+}
@@ -1,40 +1,177 @@
 #include "audio-monitor-pulse.h"
+#include "audio-monitor-filter.h"
+#include "audio-monitor-ring.h"
 #include <obs.h>
 #include <util/threading.h>
+#include <util/platform.h>
+#include <util/darray.h>
 #include <util/deque.h>
 #include <media-io/audio-resampler.h>
-#include <pulse/stream.h>
-#include <pulse/introspect.h>
-#include <pulse/thread-mainloop.h>
 
 static uint_fast32_t pulseaudio_refs = 0;
 static pthread_mutex_t pulseaudio_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pa_threaded_mainloop *pulseaudio_mainloop = NULL;
 static pa_context *pulseaudio_context = NULL;
 
-struct audio_monitor {
+/* Sink registry, filled once when the context is ready and kept current from subscription events.
+ * Only touched with the mainloop locked, the mainloop callbacks already run with it held. */
+struct pulseaudio_sink {
+	char *name;
+	uint32_t index;
+	pa_sample_spec spec;
+};
+
+static DARRAY(struct pulseaudio_sink) pulseaudio_sinks;
+static char *pulseaudio_default_sink = NULL;
+static bool pulseaudio_registry_ready = false;
+/* set from the mainloop when a sink or the default sink changed, handled on the control thread */
+static volatile bool pulseaudio_sinks_changed = false;
+
+/* frames mixed per pass of the bus write callback */
+#define MONITOR_BUS_FRAMES 1024
+/* how often a monitor that failed to start is retried */
+#define MONITOR_RETRY_NS 2000000000ULL
+/* server buffer of the latency profiles, auto starts out at the low profile */
+#define MONITOR_LATENCY_ULTRA_LOW_USEC 10000
+#define MONITOR_LATENCY_LOW_USEC 25000
+#define MONITOR_LATENCY_SAFE_USEC 60000
+/* range auto tuning moves the buffer in */
+#define MONITOR_AUTO_MIN_USEC 5000
+#define MONITOR_AUTO_MAX_USEC 200000
+/* time without underflows before auto tuning tightens the buffer again */
+#define MONITOR_AUTO_STABLE_NS 10000000000ULL
+/* fragment requested from a source that is monitored directly */
+#define MONITOR_DIRECT_FRAGMENT_USEC 5000
+
+enum monitor_state {
+	MONITOR_STATE_STOPPED,
+	MONITOR_STATE_STARTING,
+	MONITOR_STATE_RUNNING,
+	MONITOR_STATE_FAILED,
+};
+
+enum monitor_task_type {
+	MONITOR_TASK_START,
+	MONITOR_TASK_STOP,
+};
+
+struct audio_monitor;
+
+struct monitor_task {
+	struct audio_monitor *monitor;
+	enum monitor_task_type type;
+	void (*done)(struct audio_monitor *audio_monitor, bool success, void *param);
+	void *param;
+};
+
+/* Starting and stopping does blocking round trips to the server,
+ * so it is done on a control thread instead of the audio or graphics thread. */
+static pthread_mutex_t control_thread_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t control_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t control_thread;
+static os_event_t *control_event = NULL;
+static volatile bool control_exit = false;
+static struct deque control_tasks;
+static DARRAY(struct audio_monitor *) control_monitors;
+
+/* One stream per sink, the monitors routed to it are summed in float and written through it.
+ * Every bus runs its own mainloop and context, so buses never wait on each other and the shared
+ * mainloop only serves the sink registry. The bus list is only used from the control thread, which
+ * creates and destroys the buses. The stream and the monitors of a bus are only touched with the
+ * mainloop of that bus locked, so its write callback always sees a stable list. */
+struct pulseaudio_bus {
+	char *device_id;
+	/* sink the bus is connected to, device_id can be "default" */
+	char *sink_name;
+	pa_threaded_mainloop *mainloop;
+	pa_context *context;
 	pa_stream *stream;
+	pa_sample_spec spec;
 	pa_buffer_attr attr;
-	enum speaker_layout speakers;
-	pa_sample_format_t format;
+	DARRAY(struct audio_monitor *) monitors;
+	/* only monitor of a bus that has its volume and balance applied by the server, NULL for a shared bus */
+	struct audio_monitor *owner;
+	/* float scratch for sinks in another format, the mix is converted into the server buffer */
+	float *mix;
+	/* float to sink format, specialized for the format when the bus is created */
+	audio_dsp_convert_func convert;
+	/* sinks of 16 bits or less get TPDF dither */
+	bool dither;
+	struct audio_dsp_dither dither_state;
+	float *read_buffer;
+
+	/* buffer currently requested from the server */
+	pa_usec_t target_usec;
+	/* buffer used for members in auto mode, moved by the control thread */
+	pa_usec_t auto_usec;
+	volatile long underflows;
+	long seen_underflows;
+	uint64_t stable_since;
+};
+
+static DARRAY(struct pulseaudio_bus *) buses;
+
+struct audio_monitor {
+	struct pulseaudio_bus *bus;
 	uint_fast32_t samples_per_sec;
 	uint_fast32_t bytes_per_frame;
 
 	uint_fast8_t channels;
 
-	struct deque new_data;
+	/* interleaved float at the rate and channels of the bus */
+	struct audio_ring ring;
 
-	audio_resampler_t *resampler;
+	struct audio_dsp_resampler *resampler;
+	/* monitors of the same stream share the conversion of each block */
+	const void *shared_stream;
+	/* audio_dsp_resampler_quality used from the next start */
+	int resampler_quality;
 	float volume;
 	bool mono;
 	float balance;
+	/* only this pair of channels is played when above 0 */
+	int channel_pair;
+	/* volume, mono, balance and channel pair as a channel matrix, only touched by the thread that processes audio */
+	struct audio_dsp_matrix matrix;
+	/* monitor only EQ and limiter, built from the settings by the thread that processes audio */
+	struct audio_dsp_eq_limiter_settings eq_limiter_settings;
+	struct audio_dsp_eq_limiter eq_limiter;
 	pthread_mutex_t mutex;
 	char *device_id;
 	char *source_name;
-};
 
-struct pulseaudio_default_output {
-	char *default_sink_name;
+	/* written by the control thread only, retry_time is also when a running monitor records its direct source again */
+	enum monitor_state state;
+	uint64_t retry_time;
+	/* set once the monitor is on a live bus, the audio thread drops audio until then */
+	volatile bool ready;
+	/* whether the monitor should be running */
+	volatile bool active;
+	/* libpulse could not be loaded, the monitor never starts and has no control thread */
+	bool disabled;
+
+	/* latency ceiling of the ring, its policy and the audio it discarded */
+	struct monitor_latency latency;
+
+	/* source recorded straight into the ring instead of the audio of the filter, NULL when not monitoring directly.
+	 * Changed with the mutex held, record is the stream while running and is only touched with the bus locked. */
+	char *direct_source;
+	pa_stream *record;
+	/* set from the mainloop thread of the bus when the record stream failed, the control thread tears it down */
+	volatile bool record_failed;
+
+	/* volume and balance are applied by the server on a stream of its own */
+	volatile bool server_volume;
+	/* server_volume as it was when the monitor started, only used under the mutex */
+	bool offloaded;
+	/* volume or balance changed and the server was not told yet */
+	volatile bool volume_changed;
+
+	volatile long latency_profile;
+	/* buffer in ms for the custom profile */
+	volatile long custom_latency;
+	/* latency of the bus as last measured by the control thread */
+	volatile long latency_ms;
 };
 
 void pulseaudio_lock()
@@ -145,46 +282,6 @@ int_fast32_t pulseaudio_get_server_info(pa_server_info_cb_t cb, void *userdata)
 	return 0;
 }
 
-pa_stream *pulseaudio_stream_new(const char *name, const pa_sample_spec *ss, const pa_channel_map *map)
-{
-	if (pulseaudio_context_ready() < 0)
-		return NULL;
-
-	pulseaudio_lock();
-
-	pa_proplist *p = pulseaudio_properties();
-	pa_stream *s = pa_stream_new_with_proplist(pulseaudio_context, name, ss, map, p);
-	pa_proplist_free(p);
-
-	pulseaudio_unlock();
-	return s;
-}
-
-int_fast32_t pulseaudio_connect_playback(pa_stream *s, const char *name, const pa_buffer_attr *attr, pa_stream_flags_t flags)
-{
-	if (pulseaudio_context_ready() < 0)
-		return -1;
-
-	size_t dev_len = strlen(name);
-	char *device = bzalloc(dev_len + 1);
-	memcpy(device, name, dev_len);
-
-	pulseaudio_lock();
-	int_fast32_t ret = pa_stream_connect_playback(s, device, attr, flags, NULL, NULL);
-	pulseaudio_unlock();
-
-	bfree(device);
-	return ret;
-}
-
-static void pulseaudio_default_devices(pa_context *c, const pa_server_info *i, void *userdata)
-{
-	UNUSED_PARAMETER(c);
-	struct pulseaudio_default_output *d = (struct pulseaudio_default_output *)userdata;
-	d->default_sink_name = bstrdup(i->default_sink_name);
-	pulseaudio_signal(0);
-}
-
 void pulseaudio_unref()
 {
 	pthread_mutex_lock(&pulseaudio_mutex);
@@ -203,23 +300,24 @@ void pulseaudio_unref()
 			pa_threaded_mainloop_free(pulseaudio_mainloop);
 			pulseaudio_mainloop = NULL;
 		}
+
+		// The mainloop is gone, nothing can update the registry anymore.
+		for (size_t i = 0; i < pulseaudio_sinks.num; i++)
+			bfree(pulseaudio_sinks.array[i].name);
+		da_free(pulseaudio_sinks);
+		bfree(pulseaudio_default_sink);
+		pulseaudio_default_sink = NULL;
+		pulseaudio_registry_ready = false;
 	}
 
 	pthread_mutex_unlock(&pulseaudio_mutex);
 }
 
-void get_default_id(char **id)
+static void pulseaudio_notify_sinks_changed()
 {
-	struct pulseaudio_default_output *pdo = bzalloc(sizeof(struct pulseaudio_default_output));
-	pulseaudio_get_server_info((pa_server_info_cb_t)pulseaudio_default_devices, (void *)pdo);
-
-	if (!pdo->default_sink_name || !*pdo->default_sink_name) {
-		*id = NULL;
-	} else {
-		*id = pdo->default_sink_name;
-	}
-
-	bfree(pdo);
+	os_atomic_set_bool(&pulseaudio_sinks_changed, true);
+	if (control_event)
+		os_event_signal(control_event);
 }
 
 static void pulseaudio_server_info(pa_context *c, const pa_server_info *i, void *userdata)
@@ -227,19 +325,28 @@ static void pulseaudio_server_info(pa_context *c, const pa_server_info *i, void
 	UNUSED_PARAMETER(c);
 	UNUSED_PARAMETER(userdata);
 
-	blog(LOG_INFO, "Server name: '%s %s'", i->server_name, i->server_version);
+	if (!pulseaudio_registry_ready)
+		blog(LOG_INFO, "Server name: '%s %s'", i->server_name, i->server_version);
+
+	const char *default_sink = i->default_sink_name ? i->default_sink_name : "";
+	if (!pulseaudio_default_sink || strcmp(pulseaudio_default_sink, default_sink) != 0) {
+		bfree(pulseaudio_default_sink);
+		pulseaudio_default_sink = bstrdup(default_sink);
+		blog(LOG_INFO, "Default sink: '%s'", default_sink);
+		pulseaudio_notify_sinks_changed();
+	}
 
 	pulseaudio_signal(0);
 }
 
-int_fast32_t pulseaudio_get_sink_info(pa_sink_info_cb_t cb, const char *name, void *userdata)
+int_fast32_t pulseaudio_get_sink_info_list(pa_sink_info_cb_t cb, void *userdata)
 {
 	if (pulseaudio_context_ready() < 0)
 		return -1;
 
 	pulseaudio_lock();
 
-	pa_operation *op = pa_context_get_sink_info_by_name(pulseaudio_context, name, cb, userdata);
+	pa_operation *op = pa_context_get_sink_info_list(pulseaudio_context, cb, userdata);
 	if (!op) {
 		pulseaudio_unlock();
 		return -1;
@@ -348,22 +455,29 @@ static enum speaker_layout pulseaudio_channels_to_obs_speakers(uint_fast32_t cha
 	}
 }
 
+static bool pulseaudio_spec_equal(const pa_sample_spec *a, const pa_sample_spec *b)
+{
+	return a->format == b->format && a->rate == b->rate && a->channels == b->channels;
+}
+
+static struct pulseaudio_sink *pulseaudio_find_sink(const char *name)
+{
+	for (size_t i = 0; i < pulseaudio_sinks.num; i++) {
+		if (strcmp(pulseaudio_sinks.array[i].name, name) == 0)
+			return &pulseaudio_sinks.array[i];
+	}
+	return NULL;
+}
+
+/* Adds or updates a sink in the registry, runs on the mainloop thread */
 static void pulseaudio_sink_info(pa_context *c, const pa_sink_info *i, int eol, void *userdata)
 {
 	UNUSED_PARAMETER(c);
-	struct audio_monitor *data = userdata;
-	// An error occurred
-	if (eol < 0) {
-		data->format = PA_SAMPLE_INVALID;
-		goto skip;
-	}
-	// Terminating call for multi instance callbacks
-	if (eol > 0)
+	UNUSED_PARAMETER(userdata);
+	// An error occurred or terminating call for multi instance callbacks
+	if (eol != 0)
 		goto skip;
 
-	blog(LOG_INFO, "Audio format: %s, %" PRIu32 " Hz, %" PRIu8 " channels", pa_sample_format_to_string(i->sample_spec.format),
-	     i->sample_spec.rate, i->sample_spec.channels);
-
 	pa_sample_format_t format = i->sample_spec.format;
 	if (pulseaudio_to_obs_audio_format(format) == AUDIO_FORMAT_UNKNOWN) {
 		format = PA_SAMPLE_FLOAT32LE;
@@ -384,107 +498,491 @@ static void pulseaudio_sink_info(pa_context *c, const pa_sink_info *i, int eol,
 		     i->sample_spec.channels, channels);
 	}
 
-	data->format = format;
-	data->samples_per_sec = i->sample_spec.rate;
-	data->channels = channels;
+	pa_sample_spec spec = {.format = format, .rate = i->sample_spec.rate, .channels = channels};
+	struct pulseaudio_sink *sink = pulseaudio_find_sink(i->name);
+	if (sink && sink->index == i->index && pulseaudio_spec_equal(&sink->spec, &spec))
+		goto skip;
+
+	blog(LOG_INFO, "Sink '%s' audio format: %s, %" PRIu32 " Hz, %" PRIu8 " channels", i->name,
+	     pa_sample_format_to_string(i->sample_spec.format), i->sample_spec.rate, i->sample_spec.channels);
+
+	if (!sink) {
+		sink = da_push_back_new(pulseaudio_sinks);
+		sink->name = bstrdup(i->name);
+	}
+	sink->index = i->index;
+	sink->spec = spec;
+	pulseaudio_notify_sinks_changed();
 skip:
 	pulseaudio_signal(0);
 }
 
-void pulseaudio_write_callback(pa_stream *p, pa_stream_request_cb_t cb, void *userdata)
+/* Runs on the mainloop thread, changes are queried without waiting and land in the registry callbacks */
+static void pulseaudio_subscribe_event(pa_context *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata)
+{
+	UNUSED_PARAMETER(userdata);
+	const pa_subscription_event_type_t facility = t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+	const pa_subscription_event_type_t type = t & PA_SUBSCRIPTION_EVENT_TYPE_MASK;
+	pa_operation *op = NULL;
+
+	if (facility == PA_SUBSCRIPTION_EVENT_SINK) {
+		if (type == PA_SUBSCRIPTION_EVENT_REMOVE) {
+			for (size_t i = 0; i < pulseaudio_sinks.num; i++) {
+				if (pulseaudio_sinks.array[i].index != idx)
+					continue;
+				blog(LOG_INFO, "Sink '%s' removed", pulseaudio_sinks.array[i].name);
+				bfree(pulseaudio_sinks.array[i].name);
+				da_erase(pulseaudio_sinks, i);
+				pulseaudio_notify_sinks_changed();
+				break;
+			}
+		} else {
+			op = pa_context_get_sink_info_by_index(c, idx, pulseaudio_sink_info, NULL);
+		}
+	} else if (facility == PA_SUBSCRIPTION_EVENT_SERVER) {
+		op = pa_context_get_server_info(c, pulseaudio_server_info, NULL);
+	}
+
+	if (op)
+		pa_operation_unref(op);
+}
+
+/* Fills the registry and subscribes to sink and server changes, only needs to succeed once per context */
+static bool pulseaudio_registry_init()
 {
+	if (pulseaudio_registry_ready)
+		return true;
 	if (pulseaudio_context_ready() < 0)
-		return;
+		return false;
+
+	pulseaudio_lock();
+	pa_context_set_subscribe_callback(pulseaudio_context, pulseaudio_subscribe_event, NULL);
+	pa_operation *op = pa_context_subscribe(pulseaudio_context, PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_SERVER,
+						NULL, NULL);
+	if (op)
+		pa_operation_unref(op);
+	pulseaudio_unlock();
+
+	if (pulseaudio_get_server_info(pulseaudio_server_info, NULL) < 0) {
+		blog(LOG_ERROR, "Unable to get server info !");
+		return false;
+	}
+	if (pulseaudio_get_sink_info_list(pulseaudio_sink_info, NULL) < 0) {
+		blog(LOG_ERROR, "Unable to get sink info !");
+		return false;
+	}
 
 	pulseaudio_lock();
-	pa_stream_set_write_callback(p, cb, userdata);
+	pulseaudio_registry_ready = true;
 	pulseaudio_unlock();
+	return true;
 }
 
-void pulseaudio_set_underflow_callback(pa_stream *p, pa_stream_notify_cb_t cb, void *userdata)
+/* Resolves a device id from the registry without a server round trip, "default" is the current default sink */
+static bool pulseaudio_registry_find(const char *device_id, char **sink_name, pa_sample_spec *spec)
 {
-	if (pulseaudio_context_ready() < 0)
-		return;
+	if (!pulseaudio_registry_init())
+		return false;
 
 	pulseaudio_lock();
-	pa_stream_set_underflow_callback(p, cb, userdata);
+	const char *name = strcmp(device_id, "default") == 0 ? pulseaudio_default_sink : device_id;
+	struct pulseaudio_sink *sink = name ? pulseaudio_find_sink(name) : NULL;
+	if (sink) {
+		*sink_name = bstrdup(sink->name);
+		*spec = sink->spec;
+	}
 	pulseaudio_unlock();
+	return sink != NULL;
 }
 
-void audio_monitor_stop(struct audio_monitor *audio_monitor)
+/* Processes frames into the ring without a copy, whatever does not fit is counted as discarded */
+static void monitor_write(struct audio_monitor *audio_monitor, const float *samples, size_t frames)
 {
-	if (!audio_monitor)
-		return;
+	// An offloaded monitor only gets the mono downmix and channel pair, the server applies volume and balance.
+	const bool offloaded = audio_monitor->offloaded;
+	const bool copy = offloaded && !audio_monitor->mono && !audio_monitor->channel_pair;
+	if (!copy)
+		audio_dsp_matrix_update(&audio_monitor->matrix, audio_monitor->channels, offloaded ? 1.0f : audio_monitor->volume,
+					audio_monitor->mono, offloaded ? 0.0f : audio_monitor->balance,
+					audio_monitor->channel_pair);
+	audio_dsp_eq_limiter_update(&audio_monitor->eq_limiter, &audio_monitor->eq_limiter_settings, audio_monitor->channels,
+				    (uint32_t)audio_monitor->samples_per_sec);
+	monitor_ring_write(&audio_monitor->ring, &audio_monitor->latency, copy ? NULL : &audio_monitor->matrix,
+			   &audio_monitor->eq_limiter, samples, frames);
+}
 
-	pthread_mutex_lock(&audio_monitor->mutex);
+/* Sums samples of every member into mix, the first member with data is read straight into it */
+static void pulseaudio_bus_mix(struct pulseaudio_bus *bus, float *mix, size_t samples)
+{
+	const size_t size = samples * sizeof(float);
+	size_t filled = 0;
+
+	for (size_t i = 0; i < bus->monitors.num; i++) {
+		struct audio_monitor *audio_monitor = bus->monitors.array[i];
+		const uint32_t rate = (uint32_t)audio_monitor->samples_per_sec;
+		if (!filled) {
+			filled = monitor_ring_read(&audio_monitor->ring, &audio_monitor->latency, rate, (uint8_t *)mix, size) /
+				 sizeof(float);
+			continue;
+		}
 
-	if (audio_monitor->stream) {
-		/* Stop the stream */
-		pulseaudio_lock();
-		pa_stream_disconnect(audio_monitor->stream);
-		pa_stream_unref(audio_monitor->stream);
-		pulseaudio_unlock();
+		const size_t read =
+			monitor_ring_read(&audio_monitor->ring, &audio_monitor->latency, rate, (uint8_t *)bus->read_buffer, size) /
+			sizeof(float);
+		const size_t overlap = read < filled ? read : filled;
+		for (size_t j = 0; j < overlap; j++)
+			mix[j] += bus->read_buffer[j];
+		if (read > filled) {
+			memcpy(mix + filled, bus->read_buffer + filled, (read - filled) * sizeof(float));
+			filled = read;
+		}
+	}
+
+	// Monitors that are behind only add what they have, the rest of the mix stays silent.
+	if (filled < samples)
+		memset(mix + filled, 0, (samples - filled) * sizeof(float));
+}
+
+/* Called on the mainloop thread of the bus with its mainloop locked whenever the server wants more data */
+static void pulseaudio_bus_write(pa_stream *s, size_t nbytes, void *userdata)
+{
+	struct pulseaudio_bus *bus = userdata;
+	const size_t frame_size = pa_frame_size(&bus->spec);
+	const size_t channels = bus->spec.channels;
+	size_t frames = nbytes / frame_size;
+
+	while (frames > 0) {
+		void *buffer = NULL;
+		size_t bytes = frames * frame_size;
+		if (pa_stream_begin_write(s, &buffer, &bytes) || !buffer)
+			return;
+
+		size_t chunk = bytes / frame_size;
+		if (chunk > frames)
+			chunk = frames;
+		if (chunk > MONITOR_BUS_FRAMES)
+			chunk = MONITOR_BUS_FRAMES;
+		if (!chunk) {
+			pa_stream_cancel_write(s);
+			return;
+		}
 
-		audio_monitor->stream = NULL;
+		// Float sinks are mixed straight into the server buffer, others are converted into it once.
+		if (bus->spec.format == PA_SAMPLE_FLOAT32LE) {
+			pulseaudio_bus_mix(bus, buffer, chunk * channels);
+		} else {
+			pulseaudio_bus_mix(bus, bus->mix, chunk * channels);
+			bus->convert(bus->mix, buffer, chunk * channels, bus->dither ? &bus->dither_state : NULL);
+		}
+
+		pa_stream_write(s, buffer, chunk * frame_size, NULL, 0LL, PA_SEEK_RELATIVE);
+		frames -= chunk;
 	}
+}
 
-	blog(LOG_INFO, "Stopped Monitoring in '%s'", audio_monitor->device_id);
+/* Called on the mainloop thread of the bus, the control thread backs auto tuned buses off */
+static void pulseaudio_bus_underflow(pa_stream *s, void *userdata)
+{
+	UNUSED_PARAMETER(s);
+	struct pulseaudio_bus *bus = userdata;
+	os_atomic_inc_long(&bus->underflows);
+	if (control_event)
+		os_event_signal(control_event);
+}
 
-	deque_free(&audio_monitor->new_data);
-	audio_resampler_destroy(audio_monitor->resampler);
-	audio_monitor->resampler = NULL;
+static void pulseaudio_bus_lock(struct pulseaudio_bus *bus)
+{
+	pa_threaded_mainloop_lock(bus->mainloop);
+}
 
-	pthread_mutex_unlock(&audio_monitor->mutex);
+static void pulseaudio_bus_unlock(struct pulseaudio_bus *bus)
+{
+	pa_threaded_mainloop_unlock(bus->mainloop);
 }
 
-void audio_monitor_start(struct audio_monitor *audio_monitor)
+static void pulseaudio_bus_context_state_changed(pa_context *c, void *userdata)
 {
-	if (!audio_monitor)
-		return;
+	UNUSED_PARAMETER(c);
+	struct pulseaudio_bus *bus = userdata;
+	pa_threaded_mainloop_signal(bus->mainloop, 0);
+}
 
-	pthread_mutex_lock(&audio_monitor->mutex);
+/* Starts the mainloop of the bus and waits until its own context is connected */
+static bool pulseaudio_bus_connect(struct pulseaudio_bus *bus)
+{
+	bus->mainloop = pa_threaded_mainloop_new();
+	if (!bus->mainloop)
+		return false;
+	pa_threaded_mainloop_set_name(bus->mainloop, "audio-monitor: bus");
+	if (pa_threaded_mainloop_start(bus->mainloop) < 0)
+		return false;
+
+	pulseaudio_bus_lock(bus);
+	pa_proplist *p = pulseaudio_properties();
+	bus->context = pa_context_new_with_proplist(pa_threaded_mainloop_get_api(bus->mainloop), "OBS-Monitor", p);
+	pa_proplist_free(p);
 
-	pulseaudio_init();
-	char *device = NULL;
-	if (strcmp(audio_monitor->device_id, "default") == 0) {
-		get_default_id(&device);
-	} else {
-		device = bstrdup(audio_monitor->device_id);
-	}
-	if (!device) {
-		pthread_mutex_unlock(&audio_monitor->mutex);
-		return;
-	}
-	if (pulseaudio_get_server_info(pulseaudio_server_info, (void *)audio_monitor) < 0) {
-		pthread_mutex_unlock(&audio_monitor->mutex);
-		blog(LOG_ERROR, "Unable to get server info !");
-		bfree(device);
-		return;
+	pa_context_state_t state = PA_CONTEXT_FAILED;
+	if (bus->context) {
+		pa_context_set_state_callback(bus->context, pulseaudio_bus_context_state_changed, bus);
+		if (pa_context_connect(bus->context, NULL, PA_CONTEXT_NOAUTOSPAWN, NULL) >= 0) {
+			while ((state = pa_context_get_state(bus->context)) != PA_CONTEXT_READY && PA_CONTEXT_IS_GOOD(state))
+				pa_threaded_mainloop_wait(bus->mainloop);
+		}
 	}
-	if (pulseaudio_get_sink_info(pulseaudio_sink_info, device, (void *)audio_monitor) < 0) {
-		pthread_mutex_unlock(&audio_monitor->mutex);
-		blog(LOG_ERROR, "Unable to get source info !");
-		bfree(device);
-		return;
+	pulseaudio_bus_unlock(bus);
+	return state == PA_CONTEXT_READY;
+}
+
+static void pulseaudio_bus_destroy(struct pulseaudio_bus *bus)
+{
+	if (bus->mainloop) {
+		pulseaudio_bus_lock(bus);
+		if (bus->stream) {
+			pa_stream_set_write_callback(bus->stream, NULL, NULL);
+			pa_stream_set_underflow_callback(bus->stream, NULL, NULL);
+			pa_stream_disconnect(bus->stream);
+			pa_stream_unref(bus->stream);
+			blog(LOG_INFO, "Closed monitoring stream in '%s'", bus->device_id);
+		}
+		if (bus->context) {
+			pa_context_set_state_callback(bus->context, NULL, NULL);
+			pa_context_disconnect(bus->context);
+			pa_context_unref(bus->context);
+		}
+		pulseaudio_bus_unlock(bus);
+
+		pa_threaded_mainloop_stop(bus->mainloop);
+		pa_threaded_mainloop_free(bus->mainloop);
 	}
-	bfree(device);
 
-	if (audio_monitor->format == PA_SAMPLE_INVALID) {
-		pthread_mutex_unlock(&audio_monitor->mutex);
-		blog(LOG_ERROR, "An error occurred while getting the source info!");
-		return;
+	da_erase_item(buses, &bus);
+	if (!buses.num)
+		da_free(buses);
+
+	da_free(bus->monitors);
+	bfree(bus->mix);
+	bfree(bus->read_buffer);
+	bfree(bus->sink_name);
+	bfree(bus->device_id);
+	bfree(bus);
+}
+
+/* Volume and balance of every channel the way the channel matrix applies them, for the server to apply instead */
+static void monitor_server_volume(struct audio_monitor *audio_monitor, uint8_t channels, pa_cvolume *volume)
+{
+	float gains[MAX_AUDIO_CHANNELS];
+	audio_dsp_channel_gains(gains, channels, audio_monitor->volume, audio_monitor->balance);
+	volume->channels = channels;
+	for (uint8_t channel = 0; channel < channels; channel++)
+		volume->values[channel] = pa_sw_volume_from_linear(gains[channel]);
+}
+
+/* Runs on the control thread only, returns the bus of the device and opens it when it is not open yet.
+ * With an owner the bus is a stream of that monitor alone, so the server can apply its volume. */
+static struct pulseaudio_bus *pulseaudio_bus_get(const char *device_id, const char *name, struct audio_monitor *owner)
+{
+	for (size_t i = 0; !owner && i < buses.num; i++) {
+		if (!buses.array[i]->owner && strcmp(buses.array[i]->device_id, device_id) == 0)
+			return buses.array[i];
 	}
 
+	// Missing sinks are common while a device is unplugged, the monitor is retried when it shows up.
+	char *sink_name = NULL;
 	pa_sample_spec spec;
-	spec.format = audio_monitor->format;
-	spec.rate = (uint32_t)audio_monitor->samples_per_sec;
-	spec.channels = audio_monitor->channels;
+	if (!pulseaudio_registry_find(device_id, &sink_name, &spec)) {
+		blog(LOG_DEBUG, "Sink for '%s' is not available", device_id);
+		return NULL;
+	}
 
 	if (!pa_sample_spec_valid(&spec)) {
-		pthread_mutex_unlock(&audio_monitor->mutex);
 		blog(LOG_ERROR, "Sample spec is not valid");
+		bfree(sink_name);
+		return NULL;
+	}
+
+	pa_channel_map channel_map = pulseaudio_channel_map(pulseaudio_channels_to_obs_speakers(spec.channels));
+
+	struct pulseaudio_bus *bus = bzalloc(sizeof(struct pulseaudio_bus));
+	bus->device_id = bstrdup(device_id);
+	bus->sink_name = sink_name;
+	bus->spec = spec;
+	const enum audio_format format = pulseaudio_to_obs_audio_format(spec.format);
+	bus->convert = audio_dsp_get_convert(format);
+	bus->dither = format == AUDIO_FORMAT_16BIT || format == AUDIO_FORMAT_U8BIT;
+	audio_dsp_dither_init(&bus->dither_state, (uint32_t)os_gettime_ns());
+	bus->owner = owner;
+	da_push_back(buses, &bus);
+
+	if (!pulseaudio_bus_connect(bus)) {
+		blog(LOG_ERROR, "Unable to connect to the server for '%s'", device_id);
+		pulseaudio_bus_destroy(bus);
+		return NULL;
+	}
+
+	bus->attr.fragsize = (uint32_t)-1;
+	bus->attr.maxlength = (uint32_t)-1;
+	bus->attr.minreq = (uint32_t)-1;
+	bus->attr.prebuf = (uint32_t)-1;
+	// The control thread moves this to what the members ask for once the first one joined.
+	bus->target_usec = MONITOR_LATENCY_LOW_USEC;
+	bus->auto_usec = MONITOR_LATENCY_LOW_USEC;
+	bus->stable_since = os_gettime_ns();
+	bus->attr.tlength = pa_usec_to_bytes(bus->target_usec, &spec);
+
+	bus->mix = bzalloc(MONITOR_BUS_FRAMES * spec.channels * sizeof(float));
+	bus->read_buffer = bzalloc(MONITOR_BUS_FRAMES * spec.channels * sizeof(float));
+
+	// With ADJUST_LATENCY tlength is the total latency, the server sizes the sink buffer to match.
+	pa_stream_flags_t flags = PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE | PA_STREAM_ADJUST_LATENCY;
+
+	// The stream starts at the volume of its owner, later changes go through pulseaudio_bus_update_volume.
+	pa_cvolume volume;
+	if (owner) {
+		os_atomic_set_bool(&owner->volume_changed, false);
+		monitor_server_volume(owner, spec.channels, &volume);
+	}
+
+	pulseaudio_bus_lock(bus);
+	pa_proplist *p = pulseaudio_properties();
+	bus->stream = pa_stream_new_with_proplist(bus->context, name, &spec, &channel_map, p);
+	pa_proplist_free(p);
+	int ret = -1;
+	if (bus->stream) {
+		pa_stream_set_write_callback(bus->stream, pulseaudio_bus_write, bus);
+		pa_stream_set_underflow_callback(bus->stream, pulseaudio_bus_underflow, bus);
+		ret = pa_stream_connect_playback(bus->stream, sink_name, &bus->attr, flags, owner ? &volume : NULL, NULL);
+	}
+	pulseaudio_bus_unlock(bus);
+
+	if (ret < 0) {
+		blog(LOG_ERROR, "Unable to connect to stream");
+		pulseaudio_bus_destroy(bus);
+		return NULL;
+	}
+
+	blog(LOG_INFO, "Opened monitoring stream in '%s' on sink '%s'%s", device_id, sink_name,
+	     owner ? " with volume applied by the server" : "");
+	return bus;
+}
+
+/* Called on the mainloop thread of the bus, the record stream is the only writer of the ring while it exists */
+static void monitor_direct_read(pa_stream *s, size_t nbytes, void *userdata)
+{
+	UNUSED_PARAMETER(nbytes);
+	struct audio_monitor *audio_monitor = userdata;
+	const void *data;
+	size_t bytes;
+	while (pa_stream_peek(s, &data, &bytes) == 0 && bytes > 0) {
+		// Holes have no data, skipping them lets the bus fill the gap with silence.
+		if (data)
+			monitor_write(audio_monitor, data, bytes / audio_monitor->bytes_per_frame);
+		pa_stream_drop(s);
+	}
+}
+
+/* Called on the mainloop thread of the bus, a record stream that failed or ended is left to the control thread */
+static void monitor_direct_state(pa_stream *s, void *userdata)
+{
+	struct audio_monitor *audio_monitor = userdata;
+	const pa_stream_state_t state = pa_stream_get_state(s);
+	if (state != PA_STREAM_FAILED && state != PA_STREAM_TERMINATED)
 		return;
+	os_atomic_set_bool(&audio_monitor->record_failed, true);
+	if (control_event)
+		os_event_signal(control_event);
+}
+
+/* Records the source in the format of the bus on the context of the bus, so the server converts
+ * and the audio never passes through OBS */
+static bool monitor_direct_connect(struct audio_monitor *audio_monitor, struct pulseaudio_bus *bus, const char *source)
+{
+	const pa_sample_spec spec = {.format = PA_SAMPLE_FLOAT32LE, .rate = bus->spec.rate, .channels = bus->spec.channels};
+	pa_channel_map channel_map = pulseaudio_channel_map(pulseaudio_channels_to_obs_speakers(spec.channels));
+	pa_buffer_attr attr = {.maxlength = (uint32_t)-1,
+			       .tlength = (uint32_t)-1,
+			       .prebuf = (uint32_t)-1,
+			       .minreq = (uint32_t)-1,
+			       .fragsize = (uint32_t)pa_usec_to_bytes(MONITOR_DIRECT_FRAGMENT_USEC, &spec)};
+
+	pulseaudio_bus_lock(bus);
+	os_atomic_set_bool(&audio_monitor->record_failed, false);
+	pa_proplist *p = pulseaudio_properties();
+	audio_monitor->record = pa_stream_new_with_proplist(bus->context, audio_monitor->source_name, &spec, &channel_map, p);
+	pa_proplist_free(p);
+	int ret = -1;
+	if (audio_monitor->record) {
+		pa_stream_set_read_callback(audio_monitor->record, monitor_direct_read, audio_monitor);
+		pa_stream_set_state_callback(audio_monitor->record, monitor_direct_state, audio_monitor);
+		ret = pa_stream_connect_record(audio_monitor->record, strcmp(source, "default") == 0 ? NULL : source, &attr,
+					       PA_STREAM_ADJUST_LATENCY);
 	}
+	pulseaudio_bus_unlock(bus);
+
+	if (ret < 0) {
+		blog(LOG_WARNING, "Unable to record '%s' for direct monitoring", source);
+		return false;
+	}
+	blog(LOG_INFO, "Monitoring source '%s' directly in '%s'", source, audio_monitor->device_id);
+	return true;
+}
+
+/* Called with the bus locked, the read and state callbacks can not run anymore after this */
+static void monitor_direct_disconnect(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor->record)
+		return;
+	pa_stream_set_read_callback(audio_monitor->record, NULL, NULL);
+	pa_stream_set_state_callback(audio_monitor->record, NULL, NULL);
+	pa_stream_disconnect(audio_monitor->record);
+	pa_stream_unref(audio_monitor->record);
+	audio_monitor->record = NULL;
+}
+
+static void monitor_do_stop(struct audio_monitor *audio_monitor)
+{
+	// Keep the audio thread out, then wait for a callback that might still be running.
+	os_atomic_set_bool(&audio_monitor->ready, false);
+	pthread_mutex_lock(&audio_monitor->mutex);
+
+	struct pulseaudio_bus *bus = audio_monitor->bus;
+	if (bus) {
+		/* Leave the bus, the write and read callbacks can not be touching the ring after this */
+		pulseaudio_bus_lock(bus);
+		da_erase_item(bus->monitors, &audio_monitor);
+		monitor_direct_disconnect(audio_monitor);
+		pulseaudio_bus_unlock(bus);
+
+		audio_monitor->bus = NULL;
+		if (!bus->monitors.num)
+			pulseaudio_bus_destroy(bus);
+
+		blog(LOG_INFO, "Stopped Monitoring in '%s', %" PRIu64 " ms of audio discarded to keep latency bounded",
+		     audio_monitor->device_id, audio_monitor_get_discarded_ms(audio_monitor));
+	}
+
+	audio_ring_free(&audio_monitor->ring);
+	monitor_latency_stop(&audio_monitor->latency);
+	audio_dsp_resampler_destroy(audio_monitor->resampler);
+	audio_monitor->resampler = NULL;
+	audio_dsp_eq_limiter_reset(&audio_monitor->eq_limiter);
+
+	pthread_mutex_unlock(&audio_monitor->mutex);
+}
+
+/* Runs on the control thread only, the audio thread does not touch the monitor until ready is set */
+static bool monitor_do_start(struct audio_monitor *audio_monitor)
+{
+	audio_monitor->offloaded = os_atomic_load_bool(&audio_monitor->server_volume);
+	struct pulseaudio_bus *bus = pulseaudio_bus_get(audio_monitor->device_id, audio_monitor->source_name,
+							audio_monitor->offloaded ? audio_monitor : NULL);
+	if (!bus)
+		return false;
+
+	// Monitors are mixed in float, the bus converts to the format of the sink.
+	audio_monitor->samples_per_sec = bus->spec.rate;
+	audio_monitor->channels = bus->spec.channels;
+	audio_monitor->bytes_per_frame = bus->spec.channels * sizeof(float);
 
 	const struct audio_output_info *info = audio_output_get_info(obs_get_audio());
 
@@ -493,261 +991,411 @@ void audio_monitor_start(struct audio_monitor *audio_monitor)
 				     .format = AUDIO_FORMAT_FLOAT_PLANAR};
 	struct resample_info to = {.samples_per_sec = (uint32_t)audio_monitor->samples_per_sec,
 				   .speakers = pulseaudio_channels_to_obs_speakers(audio_monitor->channels),
-				   .format = pulseaudio_to_obs_audio_format(audio_monitor->format)};
+				   .format = AUDIO_FORMAT_FLOAT};
 
-	audio_monitor->resampler = audio_resampler_create(&to, &from);
+	audio_monitor->resampler = audio_dsp_resampler_create(&to, &from, audio_monitor->resampler_quality,
+							      audio_monitor->shared_stream);
 
 	if (!audio_monitor->resampler) {
-		pthread_mutex_unlock(&audio_monitor->mutex);
 		blog(LOG_WARNING, "%s: %s", __FUNCTION__, "Failed to create resampler");
-		return;
+		if (!bus->monitors.num)
+			pulseaudio_bus_destroy(bus);
+		return false;
 	}
 
-	audio_monitor->speakers = pulseaudio_channels_to_obs_speakers(spec.channels);
-	audio_monitor->bytes_per_frame = pa_frame_size(&spec);
+	audio_ring_init(&audio_monitor->ring, (size_t)pa_usec_to_bytes(MONITOR_RING_USEC, &bus->spec) / pa_frame_size(&bus->spec),
+			audio_monitor->bytes_per_frame);
+	const size_t fade_frames = (size_t)pa_usec_to_bytes(MONITOR_FADE_USEC, &bus->spec) / pa_frame_size(&bus->spec);
+	monitor_latency_start(&audio_monitor->latency, fade_frames, audio_monitor->bytes_per_frame);
 
-	pa_channel_map channel_map = pulseaudio_channel_map(audio_monitor->speakers);
+	os_atomic_set_long(&audio_monitor->latency_ms, 0);
 
-	audio_monitor->stream = pulseaudio_stream_new(audio_monitor->source_name, &spec, &channel_map);
-	if (!audio_monitor->stream) {
-		pthread_mutex_unlock(&audio_monitor->mutex);
-		blog(LOG_ERROR, "Unable to create stream");
-		return;
+	pulseaudio_bus_lock(bus);
+	da_push_back(bus->monitors, &audio_monitor);
+	pulseaudio_bus_unlock(bus);
+	audio_monitor->bus = bus;
+
+	pthread_mutex_lock(&audio_monitor->mutex);
+	char *direct_source = bstrdup(audio_monitor->direct_source);
+	pthread_mutex_unlock(&audio_monitor->mutex);
+	if (direct_source) {
+		const bool connected = monitor_direct_connect(audio_monitor, bus, direct_source);
+		bfree(direct_source);
+		if (!connected)
+			return false;
 	}
 
-	audio_monitor->attr.fragsize = (uint32_t)-1;
-	audio_monitor->attr.maxlength = (uint32_t)-1;
-	audio_monitor->attr.minreq = (uint32_t)-1;
-	audio_monitor->attr.prebuf = (uint32_t)-1;
-	audio_monitor->attr.tlength = pa_usec_to_bytes(25000, &spec);
+	blog(LOG_INFO, "Started Monitoring in '%s'", audio_monitor->device_id);
 
-	pa_stream_flags_t flags = PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE | PA_STREAM_START_CORKED;
+	os_atomic_set_bool(&audio_monitor->ready, true);
+	return true;
+}
 
-	int_fast32_t ret =
-		pulseaudio_connect_playback(audio_monitor->stream, audio_monitor->device_id, &audio_monitor->attr, flags);
-	if (ret < 0) {
-		pthread_mutex_unlock(&audio_monitor->mutex);
-		audio_monitor_stop(audio_monitor);
-		blog(LOG_ERROR, "Unable to connect to stream");
-		return;
+static void monitor_run_task(struct monitor_task *task)
+{
+	struct audio_monitor *audio_monitor = task->monitor;
+	bool success = true;
+
+	if (task->type == MONITOR_TASK_START) {
+		if (audio_monitor->state != MONITOR_STATE_RUNNING) {
+			audio_monitor->state = MONITOR_STATE_STARTING;
+			success = monitor_do_start(audio_monitor);
+			if (!success) {
+				monitor_do_stop(audio_monitor);
+				audio_monitor->retry_time = os_gettime_ns() + MONITOR_RETRY_NS;
+			}
+			audio_monitor->state = success ? MONITOR_STATE_RUNNING : MONITOR_STATE_FAILED;
+		}
+	} else if (task->type == MONITOR_TASK_STOP) {
+		monitor_do_stop(audio_monitor);
+		audio_monitor->state = MONITOR_STATE_STOPPED;
 	}
 
-	blog(LOG_INFO, "Started Monitoring in '%s'", audio_monitor->device_id);
+	if (task->done)
+		task->done(audio_monitor, success, task->param);
+}
 
-	deque_init(&audio_monitor->new_data);
+/* Monitors that should be running but failed to start are retried from here */
+static struct audio_monitor *monitor_next_retry(uint64_t now)
+{
+	struct audio_monitor *retry = NULL;
+	pthread_mutex_lock(&control_mutex);
+	for (size_t i = 0; i < control_monitors.num; i++) {
+		struct audio_monitor *audio_monitor = control_monitors.array[i];
+		if (os_atomic_load_bool(&audio_monitor->active) && audio_monitor->state == MONITOR_STATE_FAILED &&
+		    now >= audio_monitor->retry_time) {
+			retry = audio_monitor;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&control_mutex);
+	return retry;
+}
 
-	pthread_mutex_unlock(&audio_monitor->mutex);
+/* Moves buses whose sink went away, changed format or stopped being the default back to failed,
+ * their monitors reconnect from the registry as soon as a matching sink is there */
+static void monitor_check_buses()
+{
+	for (size_t i = buses.num; i > 0; i--) {
+		struct pulseaudio_bus *bus = buses.array[i - 1];
+		char *sink_name = NULL;
+		pa_sample_spec spec;
+		bool same = pulseaudio_registry_find(bus->device_id, &sink_name, &spec) &&
+			    strcmp(sink_name, bus->sink_name) == 0 && pulseaudio_spec_equal(&spec, &bus->spec);
+		bfree(sink_name);
+		if (same)
+			continue;
+
+		blog(LOG_INFO, "Sink of '%s' changed, reconnecting monitors", bus->device_id);
+		// The bus is destroyed when its last monitor leaves.
+		for (size_t count = bus->monitors.num; count > 0; count--) {
+			struct audio_monitor *audio_monitor = bus->monitors.array[0];
+			monitor_do_stop(audio_monitor);
+			audio_monitor->state = MONITOR_STATE_FAILED;
+		}
+	}
+
+	// Whatever failed before might be able to start now.
+	pthread_mutex_lock(&control_mutex);
+	for (size_t i = 0; i < control_monitors.num; i++) {
+		if (control_monitors.array[i]->state == MONITOR_STATE_FAILED)
+			control_monitors.array[i]->retry_time = 0;
+	}
+	pthread_mutex_unlock(&control_mutex);
 }
 
-static void do_stream_write(void *param)
+/* Runs on the control thread. A record stream that failed is torn down and the monitor is fed the audio of the filter
+ * again, until the direct source can be recorded again on a later retry. */
+static void pulseaudio_bus_check_records(struct pulseaudio_bus *bus, uint64_t now)
 {
-	struct audio_monitor *data = param;
-	uint8_t *buffer = NULL;
+	for (size_t i = 0; i < bus->monitors.num; i++) {
+		struct audio_monitor *audio_monitor = bus->monitors.array[i];
+		if (os_atomic_exchange_bool(&audio_monitor->record_failed, false)) {
+			// The mutex keeps the audio thread from writing the ring until the read callback is gone.
+			pthread_mutex_lock(&audio_monitor->mutex);
+			pulseaudio_bus_lock(bus);
+			const bool failed = audio_monitor->record != NULL;
+			monitor_direct_disconnect(audio_monitor);
+			pulseaudio_bus_unlock(bus);
+			if (failed)
+				blog(LOG_WARNING, "Recording '%s' for direct monitoring stopped, monitoring '%s' from OBS",
+				     audio_monitor->direct_source, audio_monitor->device_id);
+			pthread_mutex_unlock(&audio_monitor->mutex);
+			audio_monitor->retry_time = now + MONITOR_RETRY_NS;
+			continue;
+		}
+		if (audio_monitor->record || now < audio_monitor->retry_time)
+			continue;
 
-	pulseaudio_lock();
+		pthread_mutex_lock(&audio_monitor->mutex);
+		if (audio_monitor->direct_source && !monitor_direct_connect(audio_monitor, bus, audio_monitor->direct_source)) {
+			pulseaudio_bus_lock(bus);
+			monitor_direct_disconnect(audio_monitor);
+			pulseaudio_bus_unlock(bus);
+			audio_monitor->retry_time = now + MONITOR_RETRY_NS;
+		}
+		pthread_mutex_unlock(&audio_monitor->mutex);
+	}
+}
+
+static pa_usec_t monitor_latency_target(struct audio_monitor *audio_monitor, pa_usec_t auto_usec)
+{
+	switch (os_atomic_load_long(&audio_monitor->latency_profile)) {
+	case LATENCY_PROFILE_ULTRA_LOW:
+		return MONITOR_LATENCY_ULTRA_LOW_USEC;
+	case LATENCY_PROFILE_LOW:
+		return MONITOR_LATENCY_LOW_USEC;
+	case LATENCY_PROFILE_SAFE:
+		return MONITOR_LATENCY_SAFE_USEC;
+	case LATENCY_PROFILE_CUSTOM: {
+		const pa_usec_t custom = (pa_usec_t)os_atomic_load_long(&audio_monitor->custom_latency) * 1000;
+		return custom < MONITOR_AUTO_MIN_USEC ? MONITOR_AUTO_MIN_USEC : custom;
+	}
+	case LATENCY_PROFILE_AUTO:
+	default:
+		return auto_usec;
+	}
+}
 
-	// If we have grown a large buffer internally, grow the pulse buffer to match so we can write our data out.
-	if (data->new_data.size > data->attr.tlength * 2) {
-		data->attr.fragsize = (uint32_t)-1;
-		data->attr.maxlength = (uint32_t)-1;
-		data->attr.prebuf = (uint32_t)-1;
-		data->attr.minreq = (uint32_t)-1;
-		data->attr.tlength = data->new_data.size;
-		pa_stream_set_buffer_attr(data->stream, &data->attr, NULL, NULL);
+/* Runs on the control thread, backs the auto buffer off after an underflow and tightens it after a quiet stretch,
+ * then requests the lowest buffer any member asks for and measures what the server gave */
+static void pulseaudio_bus_tune(struct pulseaudio_bus *bus, uint64_t now)
+{
+	const long underflows = os_atomic_load_long(&bus->underflows);
+	if (underflows != bus->seen_underflows) {
+		bus->seen_underflows = underflows;
+		bus->stable_since = now;
+		bus->auto_usec = bus->auto_usec * 3 / 2;
+		if (bus->auto_usec > MONITOR_AUTO_MAX_USEC)
+			bus->auto_usec = MONITOR_AUTO_MAX_USEC;
+	} else if (now - bus->stable_since >= MONITOR_AUTO_STABLE_NS) {
+		bus->stable_since = now;
+		bus->auto_usec = bus->auto_usec * 4 / 5;
+		if (bus->auto_usec < MONITOR_AUTO_MIN_USEC)
+			bus->auto_usec = MONITOR_AUTO_MIN_USEC;
 	}
 
-	// Buffer up enough data before we start playing.
-	if (pa_stream_is_corked(data->stream)) {
-		if (data->new_data.size >= data->attr.tlength) {
-			pa_stream_cork(data->stream, 0, NULL, NULL);
-		} else {
-			goto finish;
+	pa_usec_t target = 0;
+	for (size_t i = 0; i < bus->monitors.num; i++) {
+		const pa_usec_t monitor_target = monitor_latency_target(bus->monitors.array[i], bus->auto_usec);
+		if (!target || monitor_target < target)
+			target = monitor_target;
+	}
+
+	// Until the stream is ready the change stays pending and is retried on the next pass.
+	pulseaudio_bus_lock(bus);
+	if (target && target != bus->target_usec && pa_stream_get_state(bus->stream) == PA_STREAM_READY) {
+		pa_buffer_attr attr = bus->attr;
+		attr.tlength = pa_usec_to_bytes(target, &bus->spec);
+		pa_operation *op = pa_stream_set_buffer_attr(bus->stream, &attr, NULL, NULL);
+		if (op) {
+			pa_operation_unref(op);
+			blog(LOG_INFO, "Monitoring stream in '%s' buffer changed from %" PRIu64 " to %" PRIu64 " ms",
+			     bus->device_id, (uint64_t)bus->target_usec / 1000, (uint64_t)target / 1000);
+			bus->target_usec = target;
+			bus->attr = attr;
 		}
 	}
 
-	while (data->new_data.size > 0) {
-		size_t bytesToFill = data->new_data.size;
-		if (pa_stream_begin_write(data->stream, (void **)&buffer, &bytesToFill))
-			goto finish;
+	// Fails until the first timing update came in, the previous value is kept until then.
+	pa_usec_t latency = 0;
+	int negative = 0;
+	if (pa_stream_get_latency(bus->stream, &latency, &negative) == 0) {
+		const long latency_ms = negative ? 0 : (long)(latency / 1000);
+		for (size_t i = 0; i < bus->monitors.num; i++)
+			os_atomic_set_long(&bus->monitors.array[i]->latency_ms, latency_ms);
+	}
+	pulseaudio_bus_unlock(bus);
+}
+
+/* Runs on the control thread, hands volume and balance changes of the owner to the server */
+static void pulseaudio_bus_update_volume(struct pulseaudio_bus *bus)
+{
+	if (!bus->owner || !os_atomic_load_bool(&bus->owner->volume_changed))
+		return;
+
+	// Until the stream is ready the change stays pending and is retried on the next pass.
+	pulseaudio_bus_lock(bus);
+	if (pa_stream_get_state(bus->stream) == PA_STREAM_READY) {
+		os_atomic_set_bool(&bus->owner->volume_changed, false);
+		pa_cvolume volume;
+		monitor_server_volume(bus->owner, bus->spec.channels, &volume);
+		pa_operation *op =
+			pa_context_set_sink_input_volume(bus->context, pa_stream_get_index(bus->stream), &volume, NULL, NULL);
+		if (op)
+			pa_operation_unref(op);
+	}
+	pulseaudio_bus_unlock(bus);
+}
+
+static void *monitor_control_thread(void *param)
+{
+	UNUSED_PARAMETER(param);
+	os_set_thread_name("audio-monitor: control");
+	// The context lives as long as this thread, so the registry callbacks can always reach control_event.
+	pulseaudio_init();
 
-		// PA may request we submit more or less data than we have.
-		// Wait for more data if we cannot perform a full write.
-		if (bytesToFill > data->new_data.size) {
-			pa_stream_cancel_write(data->stream);
-			goto finish;
+	while (true) {
+		os_event_timedwait(control_event, MONITOR_RETRY_NS / 1000000);
+
+		struct monitor_task task;
+		bool have_task = true;
+		while (have_task) {
+			pthread_mutex_lock(&control_mutex);
+			have_task = control_tasks.size >= sizeof(task);
+			if (have_task)
+				deque_pop_front(&control_tasks, &task, sizeof(task));
+			pthread_mutex_unlock(&control_mutex);
+			if (have_task)
+				monitor_run_task(&task);
 		}
 
-		deque_pop_front(&data->new_data, buffer, bytesToFill);
+		if (os_atomic_load_bool(&control_exit))
+			break;
+
+		if (os_atomic_exchange_bool(&pulseaudio_sinks_changed, false))
+			monitor_check_buses();
+
+		// A failed start pushes retry_time forward, so this ends once every due monitor was tried.
+		struct audio_monitor *retry;
+		while ((retry = monitor_next_retry(os_gettime_ns())) != NULL) {
+			task.monitor = retry;
+			task.type = MONITOR_TASK_START;
+			task.done = NULL;
+			task.param = NULL;
+			monitor_run_task(&task);
+		}
 
-		pa_stream_write(data->stream, buffer, bytesToFill, NULL, 0LL, PA_SEEK_RELATIVE);
+		const uint64_t now = os_gettime_ns();
+		for (size_t i = 0; i < buses.num; i++) {
+			pulseaudio_bus_check_records(buses.array[i], now);
+			pulseaudio_bus_update_volume(buses.array[i]);
+			pulseaudio_bus_tune(buses.array[i], now);
+		}
 	}
-finish:
-	pulseaudio_unlock();
+
+	pulseaudio_unref();
+	return NULL;
+}
+
+static void monitor_post_task(struct audio_monitor *audio_monitor, enum monitor_task_type type,
+			      void (*done)(struct audio_monitor *, bool, void *), void *param)
+{
+	struct monitor_task task = {.monitor = audio_monitor, .type = type, .done = done, .param = param};
+	pthread_mutex_lock(&control_mutex);
+	deque_push_back(&control_tasks, &task, sizeof(task));
+	pthread_mutex_unlock(&control_mutex);
+	os_event_signal(control_event);
+}
+
+static void monitor_control_add(struct audio_monitor *audio_monitor)
+{
+	pthread_mutex_lock(&control_thread_mutex);
+	pthread_mutex_lock(&control_mutex);
+	const bool first = control_monitors.num == 0;
+	da_push_back(control_monitors, &audio_monitor);
+	pthread_mutex_unlock(&control_mutex);
+
+	if (first) {
+		os_event_init(&control_event, OS_EVENT_TYPE_AUTO);
+		os_atomic_set_bool(&control_exit, false);
+		pthread_create(&control_thread, NULL, monitor_control_thread, NULL);
+	}
+	pthread_mutex_unlock(&control_thread_mutex);
+}
+
+static void monitor_control_remove(struct audio_monitor *audio_monitor)
+{
+	pthread_mutex_lock(&control_thread_mutex);
+	pthread_mutex_lock(&control_mutex);
+	da_erase_item(control_monitors, &audio_monitor);
+	const bool last = control_monitors.num == 0;
+	pthread_mutex_unlock(&control_mutex);
+
+	if (last) {
+		os_atomic_set_bool(&control_exit, true);
+		os_event_signal(control_event);
+		pthread_join(control_thread, NULL);
+		os_event_destroy(control_event);
+		control_event = NULL;
+
+		pthread_mutex_lock(&control_mutex);
+		deque_free(&control_tasks);
+		da_free(control_monitors);
+		pthread_mutex_unlock(&control_mutex);
+	}
+	pthread_mutex_unlock(&control_thread_mutex);
+}
+
+static void monitor_signal_done(struct audio_monitor *audio_monitor, bool success, void *param)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(success);
+	os_event_signal(param);
+}
+
+void audio_monitor_stop(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor || audio_monitor->disabled)
+		return;
+
+	os_atomic_set_bool(&audio_monitor->active, false);
+	monitor_post_task(audio_monitor, MONITOR_TASK_STOP, NULL, NULL);
+}
+
+void audio_monitor_start(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor || audio_monitor->disabled)
+		return;
+
+	os_atomic_set_bool(&audio_monitor->active, true);
+	monitor_post_task(audio_monitor, MONITOR_TASK_START, NULL, NULL);
 }
 
 void audio_monitor_audio(void *data, struct obs_audio_data *audio)
 {
 	struct audio_monitor *audio_monitor = data;
+	// Drop audio until the control thread has the stream live.
+	if (!os_atomic_load_bool(&audio_monitor->ready))
+		return;
 	pthread_mutex_lock(&audio_monitor->mutex);
-	if (!audio_monitor->resampler && audio_monitor->device_id && strlen(audio_monitor->device_id)) {
-		pthread_mutex_unlock(&audio_monitor->mutex);
-		audio_monitor_start(audio_monitor);
-		pthread_mutex_lock(&audio_monitor->mutex);
-		
-	}
-	if (!audio_monitor->resampler) {
+	// A direct monitor is fed by its record stream, the audio of the source is not needed.
+	if (!os_atomic_load_bool(&audio_monitor->ready) || !audio_monitor->resampler || audio_monitor->record) {
 		pthread_mutex_unlock(&audio_monitor->mutex);
 		return;
 	}
 
-	uint8_t *resample_data[MAX_AV_PLANES];
+	const uint8_t *resample_data[MAX_AV_PLANES];
 	uint32_t resample_frames;
 	uint64_t ts_offset;
-	bool success = audio_resampler_resample(audio_monitor->resampler, resample_data, &resample_frames, &ts_offset,
-						(const uint8_t *const *)audio->data, (uint32_t)audio->frames);
+	bool success = audio_dsp_resampler_resample(audio_monitor->resampler, resample_data, &resample_frames, &ts_offset,
+						    (const uint8_t *const *)audio->data, (uint32_t)audio->frames, audio->timestamp);
 	if (!success) {
 		pthread_mutex_unlock(&audio_monitor->mutex);
 		return;
 	}
 
-	/* apply volume */
-	float vol = audio_monitor->volume;
-	if (!close_float(vol, 1.0f, EPSILON)) {
-		if (pulseaudio_to_obs_audio_format(audio_monitor->format) == AUDIO_FORMAT_FLOAT) {
-			register float *cur = (float *)resample_data[0];
-			register float *end = cur + resample_frames * audio_monitor->channels;
-
-			while (cur < end)
-				*(cur++) *= vol;
-		} else if (pulseaudio_to_obs_audio_format(audio_monitor->format) == AUDIO_FORMAT_32BIT) {
-			register int32_t *cur = (int32_t *)resample_data[0];
-			register int32_t *end = cur + resample_frames * audio_monitor->channels;
-			while (cur < end) {
-				*cur = (int32_t)((float)*cur * vol);
-				cur++;
-			}
-		} else if (pulseaudio_to_obs_audio_format(audio_monitor->format) == AUDIO_FORMAT_16BIT) {
-			register int16_t *cur = (int16_t *)resample_data[0];
-			register int16_t *end = cur + resample_frames * audio_monitor->channels;
-
-			while (cur < end) {
-				*cur = (int16_t)((float)*cur * vol);
-				cur++;
-			}
-		} else if (pulseaudio_to_obs_audio_format(audio_monitor->format) == AUDIO_FORMAT_U8BIT) {
-			register uint8_t *cur = resample_data[0];
-			register uint8_t *end = cur + resample_frames * audio_monitor->channels;
-
-			while (cur < end) {
-				*cur = (uint8_t)((float)*cur * vol);
-				cur++;
-			}
-		}
-	}
-
-	/* apply mono */
-	if (audio_monitor->mono && audio_monitor->channels > 1) {
-		if (pulseaudio_to_obs_audio_format(audio_monitor->format) == AUDIO_FORMAT_FLOAT) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				float avg = 0.0f;
-				for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-					avg += ((float *)resample_data[0])[frame * audio_monitor->channels + channel];
-				}
-				avg /= (float)audio_monitor->channels;
-				for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-					((float *)resample_data[0])[frame * audio_monitor->channels + channel] = avg;
-				}
-			}
-		} else if (pulseaudio_to_obs_audio_format(audio_monitor->format) == AUDIO_FORMAT_32BIT) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				int64_t avg = 0;
-				for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-					avg += ((int32_t *)resample_data[0])[frame * audio_monitor->channels + channel];
-				}
-				avg /= audio_monitor->channels;
-				for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-					((int32_t *)resample_data[0])[frame * audio_monitor->channels + channel] = (int32_t)avg;
-				}
-			}
-		} else if (pulseaudio_to_obs_audio_format(audio_monitor->format) == AUDIO_FORMAT_16BIT) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				int64_t avg = 0;
-				for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-					avg += ((int16_t *)resample_data[0])[frame * audio_monitor->channels + channel];
-				}
-				avg /= audio_monitor->channels;
-				for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-					((int16_t *)resample_data[0])[frame * audio_monitor->channels + channel] = (int16_t)avg;
-				}
-			}
-		} else if (pulseaudio_to_obs_audio_format(audio_monitor->format) == AUDIO_FORMAT_U8BIT) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				uint64_t avg = 0;
-				for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-					avg += ((uint8_t *)resample_data[0])[frame * audio_monitor->channels + channel];
-				}
-				avg /= audio_monitor->channels;
-				for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-					((uint8_t *)resample_data[0])[frame * audio_monitor->channels + channel] = (uint8_t)avg;
-				}
-			}
-		}
-	}
-
-	/* apply balance */
-	float bal = (audio_monitor->balance + 1.0f) / 2.0f;
-	if (!close_float(bal, 0.5f, EPSILON) && audio_monitor->channels > 1) {
-		if (pulseaudio_to_obs_audio_format(audio_monitor->format) == AUDIO_FORMAT_FLOAT) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				((float *)resample_data[0])[frame * audio_monitor->channels + 0] =
-					((float *)resample_data[0])[frame * audio_monitor->channels + 0] *
-					sinf((1.0f - bal) * (M_PI / 2.0f));
-				((float *)resample_data[0])[frame * audio_monitor->channels + 1] =
-					((float *)resample_data[0])[frame * audio_monitor->channels + 1] *
-					sinf(bal * (M_PI / 2.0f));
-			}
-		} else if (pulseaudio_to_obs_audio_format(audio_monitor->format) == AUDIO_FORMAT_32BIT) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				((int32_t *)resample_data[0])[frame * audio_monitor->channels + 0] =
-					(int32_t)((float)((int32_t *)resample_data[0])[frame * audio_monitor->channels + 0] *
-						  sinf((1.0f - bal) * (M_PI / 2.0f)));
-				((int32_t *)resample_data[0])[frame * audio_monitor->channels + 1] =
-					(int32_t)((float)((int32_t *)resample_data[0])[frame * audio_monitor->channels + 1] *
-						  sinf(bal * (M_PI / 2.0f)));
-			}
-		} else if (pulseaudio_to_obs_audio_format(audio_monitor->format) == AUDIO_FORMAT_16BIT) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				((int16_t *)resample_data[0])[frame * audio_monitor->channels + 0] =
-					(int16_t)((float)((int16_t *)resample_data[0])[frame * audio_monitor->channels + 0] *
-						  sinf((1.0f - bal) * (M_PI / 2.0f)));
-				((int16_t *)resample_data[0])[frame * audio_monitor->channels + 1] =
-					(int16_t)((float)((int16_t *)resample_data[0])[frame * audio_monitor->channels + 1] *
-						  sinf(bal * (M_PI / 2.0f)));
-			}
-		} else if (pulseaudio_to_obs_audio_format(audio_monitor->format) == AUDIO_FORMAT_U8BIT) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				((uint8_t *)resample_data[0])[frame * audio_monitor->channels + 0] =
-					(uint8_t)((float)((uint8_t *)resample_data[0])[frame * audio_monitor->channels + 0] *
-						  sinf((1.0f - bal) * (M_PI / 2.0f)));
-				((uint8_t *)resample_data[0])[frame * audio_monitor->channels + 1] =
-					(uint8_t)((float)((uint8_t *)resample_data[0])[frame * audio_monitor->channels + 1] *
-						  sinf(bal * (M_PI / 2.0f)));
-			}
-		}
-	}
-
-	size_t bytes = audio_monitor->bytes_per_frame * resample_frames;
-
-	deque_push_back(&audio_monitor->new_data, resample_data[0], bytes);
-	do_stream_write(data);
+	// Process straight into the ring, the bus write callback drains it on the mainloop thread.
+	monitor_write(audio_monitor, (const float *)resample_data[0], resample_frames);
 	pthread_mutex_unlock(&audio_monitor->mutex);
 }
 
+/* Slider moves of an offloaded monitor only wake the control thread, the audio thread is not involved */
+static void monitor_volume_changed(struct audio_monitor *audio_monitor)
+{
+	if (!os_atomic_load_bool(&audio_monitor->server_volume))
+		return;
+	os_atomic_set_bool(&audio_monitor->volume_changed, true);
+	if (control_event)
+		os_event_signal(control_event);
+}
+
 void audio_monitor_set_volume(struct audio_monitor *audio_monitor, float volume)
 {
-	if (!audio_monitor)
+	if (!audio_monitor || audio_monitor->volume == volume)
 		return;
 	audio_monitor->volume = volume;
+	monitor_volume_changed(audio_monitor);
 }
 
 void audio_monitor_set_mono(struct audio_monitor *audio_monitor, bool mono)
@@ -759,9 +1407,38 @@ void audio_monitor_set_mono(struct audio_monitor *audio_monitor, bool mono)
 
 void audio_monitor_set_balance(struct audio_monitor *audio_monitor, float balance)
 {
-	if (!audio_monitor)
+	if (!audio_monitor || audio_monitor->balance == balance)
 		return;
 	audio_monitor->balance = balance;
+	monitor_volume_changed(audio_monitor);
+}
+
+void audio_monitor_set_channel_pair(struct audio_monitor *audio_monitor, int channel_pair)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->channel_pair = channel_pair;
+}
+
+void audio_monitor_set_stream(struct audio_monitor *audio_monitor, const void *stream)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->shared_stream = stream;
+}
+
+void audio_monitor_set_resampler_quality(struct audio_monitor *audio_monitor, int quality)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->resampler_quality = quality;
+}
+
+void audio_monitor_set_eq_limiter(struct audio_monitor *audio_monitor, const struct audio_dsp_eq_limiter_settings *settings)
+{
+	if (!audio_monitor || !settings)
+		return;
+	audio_monitor->eq_limiter_settings = *settings;
 }
 
 struct audio_monitor *audio_monitor_create(const char *device_id, const char *source_name, int port)
@@ -770,7 +1447,14 @@ struct audio_monitor *audio_monitor_create(const char *device_id, const char *so
 	struct audio_monitor *audio_monitor = bzalloc(sizeof(struct audio_monitor));
 	audio_monitor->device_id = bstrdup(device_id);
 	audio_monitor->source_name = bstrdup(source_name);
+	monitor_latency_init(&audio_monitor->latency);
+	audio_monitor->latency_profile = LATENCY_PROFILE_AUTO;
+	audio_monitor->custom_latency = MONITOR_LATENCY_LOW_USEC / 1000;
 	pthread_mutex_init(&audio_monitor->mutex, NULL);
+	// libpulse is only opened once a monitor exists, without it the monitor stays silent.
+	audio_monitor->disabled = !pulseaudio_api_load();
+	if (!audio_monitor->disabled)
+		monitor_control_add(audio_monitor);
 	return audio_monitor;
 }
 
@@ -778,8 +1462,20 @@ void audio_monitor_destroy(struct audio_monitor *audio_monitor)
 {
 	if (!audio_monitor)
 		return;
-	audio_monitor_stop(audio_monitor);
+
+	// The stop has to be finished before the monitor can be freed.
+	if (!audio_monitor->disabled) {
+		os_event_t *stopped;
+		os_event_init(&stopped, OS_EVENT_TYPE_MANUAL);
+		os_atomic_set_bool(&audio_monitor->active, false);
+		monitor_post_task(audio_monitor, MONITOR_TASK_STOP, monitor_signal_done, stopped);
+		os_event_wait(stopped);
+		os_event_destroy(stopped);
+		monitor_control_remove(audio_monitor);
+	}
+
 	pthread_mutex_destroy(&audio_monitor->mutex);
+	bfree(audio_monitor->direct_source);
 	bfree(audio_monitor->source_name);
 	bfree(audio_monitor->device_id);
 	bfree(audio_monitor);
@@ -803,3 +1499,73 @@ void audio_monitor_set_samples_per_sec(struct audio_monitor *audio_monitor, long
 	UNUSED_PARAMETER(audio_monitor);
 	UNUSED_PARAMETER(samples_per_sec);
 }
+
+void audio_monitor_set_max_latency(struct audio_monitor *audio_monitor, long long max_latency, int policy)
+{
+	if (!audio_monitor)
+		return;
+	monitor_latency_set(&audio_monitor->latency, max_latency, policy);
+}
+
+uint64_t audio_monitor_get_discarded_ms(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor)
+		return 0;
+	return monitor_latency_get_discarded_ms(&audio_monitor->latency, (uint32_t)audio_monitor->samples_per_sec);
+}
+
+void audio_monitor_set_latency_profile(struct audio_monitor *audio_monitor, int profile, long long custom_ms)
+{
+	if (!audio_monitor)
+		return;
+	os_atomic_set_long(&audio_monitor->latency_profile, profile);
+	os_atomic_set_long(&audio_monitor->custom_latency, custom_ms > 0 ? (long)custom_ms : 0);
+	// The bus picks the new buffer up on the next pass of the control thread.
+	if (control_event)
+		os_event_signal(control_event);
+}
+
+uint64_t audio_monitor_get_latency_ms(struct audio_monitor *audio_monitor)
+{
+	if (!audio_monitor || !os_atomic_load_bool(&audio_monitor->ready))
+		return 0;
+	pthread_mutex_lock(&audio_monitor->mutex);
+	const uint64_t processing_ns = audio_dsp_resampler_get_latency_ns(audio_monitor->resampler) +
+				       audio_dsp_eq_limiter_get_latency_ns(&audio_monitor->eq_limiter);
+	pthread_mutex_unlock(&audio_monitor->mutex);
+	return (uint64_t)os_atomic_load_long(&audio_monitor->latency_ms) + processing_ns / 1000000;
+}
+
+void audio_monitor_set_server_volume(struct audio_monitor *audio_monitor, bool server_volume)
+{
+	if (!audio_monitor || os_atomic_load_bool(&audio_monitor->server_volume) == server_volume)
+		return;
+	os_atomic_set_bool(&audio_monitor->server_volume, server_volume);
+
+	// Moving between the shared stream of the sink and a stream of its own takes a restart.
+	if (os_atomic_load_bool(&audio_monitor->active)) {
+		monitor_post_task(audio_monitor, MONITOR_TASK_STOP, NULL, NULL);
+		monitor_post_task(audio_monitor, MONITOR_TASK_START, NULL, NULL);
+	}
+}
+
+void audio_monitor_set_direct_source(struct audio_monitor *audio_monitor, const char *source)
+{
+	if (!audio_monitor)
+		return;
+
+	pthread_mutex_lock(&audio_monitor->mutex);
+	const bool changed = source ? !audio_monitor->direct_source || strcmp(audio_monitor->direct_source, source) != 0
+				    : audio_monitor->direct_source != NULL;
+	if (changed) {
+		bfree(audio_monitor->direct_source);
+		audio_monitor->direct_source = bstrdup(source);
+	}
+	pthread_mutex_unlock(&audio_monitor->mutex);
+
+	// The record stream is set up when the monitor starts.
+	if (changed && os_atomic_load_bool(&audio_monitor->active)) {
+		monitor_post_task(audio_monitor, MONITOR_TASK_STOP, NULL, NULL);
+		monitor_post_task(audio_monitor, MONITOR_TASK_START, NULL, NULL);
+	}
+}
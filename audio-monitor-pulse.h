@@ -0,0 +1,124 @@
+#pragma once
+#include <stdbool.h>
+#include <pulse/stream.h>
+#include <pulse/introspect.h>
+#include <pulse/subscribe.h>
+#include <pulse/thread-mainloop.h>
+
+/* libpulse is opened when the first monitor is created instead of being linked, so loading the plugin
+ * does not pull it in. Every function the backend calls is listed here and goes through pulseaudio_api. */
+#define PULSEAUDIO_API_FUNCS(X)              \
+	X(pa_context_connect)                \
+	X(pa_context_disconnect)             \
+	X(pa_context_get_server_info)        \
+	X(pa_context_get_sink_info_by_index) \
+	X(pa_context_get_sink_info_by_name)  \
+	X(pa_context_get_sink_info_list)     \
+	X(pa_context_get_state)              \
+	X(pa_context_new_with_proplist)      \
+	X(pa_context_set_sink_input_volume)  \
+	X(pa_context_set_state_callback)     \
+	X(pa_context_set_subscribe_callback) \
+	X(pa_context_subscribe)              \
+	X(pa_context_unref)                  \
+	X(pa_frame_size)                     \
+	X(pa_operation_get_state)            \
+	X(pa_operation_unref)                \
+	X(pa_proplist_free)                  \
+	X(pa_proplist_new)                   \
+	X(pa_proplist_sets)                  \
+	X(pa_sample_format_to_string)        \
+	X(pa_sample_spec_valid)              \
+	X(pa_stream_begin_write)             \
+	X(pa_stream_cancel_write)            \
+	X(pa_stream_connect_playback)        \
+	X(pa_stream_connect_record)          \
+	X(pa_stream_disconnect)              \
+	X(pa_stream_drop)                    \
+	X(pa_stream_get_index)               \
+	X(pa_stream_get_latency)             \
+	X(pa_stream_get_state)               \
+	X(pa_stream_new_with_proplist)       \
+	X(pa_stream_peek)                    \
+	X(pa_stream_set_buffer_attr)         \
+	X(pa_stream_set_read_callback)       \
+	X(pa_stream_set_underflow_callback)  \
+	X(pa_stream_set_write_callback)      \
+	X(pa_stream_unref)                   \
+	X(pa_stream_write)                   \
+	X(pa_sw_volume_from_linear)          \
+	X(pa_threaded_mainloop_free)         \
+	X(pa_threaded_mainloop_get_api)      \
+	X(pa_threaded_mainloop_lock)         \
+	X(pa_threaded_mainloop_new)          \
+	X(pa_threaded_mainloop_set_name)     \
+	X(pa_threaded_mainloop_signal)       \
+	X(pa_threaded_mainloop_start)        \
+	X(pa_threaded_mainloop_stop)         \
+	X(pa_threaded_mainloop_unlock)       \
+	X(pa_threaded_mainloop_wait)         \
+	X(pa_usec_to_bytes)
+
+#define PULSEAUDIO_API_MEMBER(func) __typeof__(func) *func;
+struct pulseaudio_api {
+	PULSEAUDIO_API_FUNCS(PULSEAUDIO_API_MEMBER)
+};
+#undef PULSEAUDIO_API_MEMBER
+
+extern struct pulseaudio_api pulseaudio_api;
+
+/* Opens libpulse once and resolves every function, false when it is not installed */
+bool pulseaudio_api_load(void);
+
+#ifndef PULSEAUDIO_API_IMPLEMENTATION
+#define pa_context_connect pulseaudio_api.pa_context_connect
+#define pa_context_disconnect pulseaudio_api.pa_context_disconnect
+#define pa_context_get_server_info pulseaudio_api.pa_context_get_server_info
+#define pa_context_get_sink_info_by_index pulseaudio_api.pa_context_get_sink_info_by_index
+#define pa_context_get_sink_info_by_name pulseaudio_api.pa_context_get_sink_info_by_name
+#define pa_context_get_sink_info_list pulseaudio_api.pa_context_get_sink_info_list
+#define pa_context_get_state pulseaudio_api.pa_context_get_state
+#define pa_context_new_with_proplist pulseaudio_api.pa_context_new_with_proplist
+#define pa_context_set_sink_input_volume pulseaudio_api.pa_context_set_sink_input_volume
+#define pa_context_set_state_callback pulseaudio_api.pa_context_set_state_callback
+#define pa_context_set_subscribe_callback pulseaudio_api.pa_context_set_subscribe_callback
+#define pa_context_subscribe pulseaudio_api.pa_context_subscribe
+#define pa_context_unref pulseaudio_api.pa_context_unref
+#define pa_frame_size pulseaudio_api.pa_frame_size
+#define pa_operation_get_state pulseaudio_api.pa_operation_get_state
+#define pa_operation_unref pulseaudio_api.pa_operation_unref
+#define pa_proplist_free pulseaudio_api.pa_proplist_free
+#define pa_proplist_new pulseaudio_api.pa_proplist_new
+#define pa_proplist_sets pulseaudio_api.pa_proplist_sets
+#define pa_sample_format_to_string pulseaudio_api.pa_sample_format_to_string
+#define pa_sample_spec_valid pulseaudio_api.pa_sample_spec_valid
+#define pa_stream_begin_write pulseaudio_api.pa_stream_begin_write
+#define pa_stream_cancel_write pulseaudio_api.pa_stream_cancel_write
+#define pa_stream_connect_playback pulseaudio_api.pa_stream_connect_playback
+#define pa_stream_connect_record pulseaudio_api.pa_stream_connect_record
+#define pa_stream_disconnect pulseaudio_api.pa_stream_disconnect
+#define pa_stream_drop pulseaudio_api.pa_stream_drop
+#define pa_stream_get_index pulseaudio_api.pa_stream_get_index
+#define pa_stream_get_latency pulseaudio_api.pa_stream_get_latency
+#define pa_stream_get_state pulseaudio_api.pa_stream_get_state
+#define pa_stream_new_with_proplist pulseaudio_api.pa_stream_new_with_proplist
+#define pa_stream_peek pulseaudio_api.pa_stream_peek
+#define pa_stream_set_buffer_attr pulseaudio_api.pa_stream_set_buffer_attr
+#define pa_stream_set_read_callback pulseaudio_api.pa_stream_set_read_callback
+#define pa_stream_set_underflow_callback pulseaudio_api.pa_stream_set_underflow_callback
+#define pa_stream_set_write_callback pulseaudio_api.pa_stream_set_write_callback
+#define pa_stream_unref pulseaudio_api.pa_stream_unref
+#define pa_stream_write pulseaudio_api.pa_stream_write
+#define pa_sw_volume_from_linear pulseaudio_api.pa_sw_volume_from_linear
+#define pa_threaded_mainloop_free pulseaudio_api.pa_threaded_mainloop_free
+#define pa_threaded_mainloop_get_api pulseaudio_api.pa_threaded_mainloop_get_api
+#define pa_threaded_mainloop_lock pulseaudio_api.pa_threaded_mainloop_lock
+#define pa_threaded_mainloop_new pulseaudio_api.pa_threaded_mainloop_new
+#define pa_threaded_mainloop_set_name pulseaudio_api.pa_threaded_mainloop_set_name
+#define pa_threaded_mainloop_signal pulseaudio_api.pa_threaded_mainloop_signal
+#define pa_threaded_mainloop_start pulseaudio_api.pa_threaded_mainloop_start
+#define pa_threaded_mainloop_stop pulseaudio_api.pa_threaded_mainloop_stop
+#define pa_threaded_mainloop_unlock pulseaudio_api.pa_threaded_mainloop_unlock
+#define pa_threaded_mainloop_wait pulseaudio_api.pa_threaded_mainloop_wait
+#define pa_usec_to_bytes pulseaudio_api.pa_usec_to_bytes
+#endif
@@ -0,0 +1,151 @@
+#pragma once
+#include "audio-dsp.h"
+#include "audio-monitor-filter.h"
+#include "audio-ring.h"
+
+/* audio that can be queued between the OBS audio thread and the thread that plays it */
+#define MONITOR_RING_USEC 500000
+/* crossfade length used when audio is skipped to stay under the latency ceiling */
+#define MONITOR_FADE_USEC 5000
+/* latency ceiling for monitors that never had one set, like the dock outputs */
+#define MONITOR_DEFAULT_MAX_LATENCY 200
+
+/* Latency ceiling of the interleaved float ring of a monitor and what to do with the audio above it.
+ * The ceiling, the policy and the counter are atomics set from any thread,
+ * the fade buffers belong to the thread that reads the ring. */
+struct monitor_latency {
+	/* ceiling in ms on audio queued in the ring, 0 is unlimited */
+	volatile long max_latency;
+	volatile long policy;
+	volatile long discarded_frames;
+	float *fade_from;
+	float *fade_to;
+	size_t fade_frames;
+};
+
+static inline void monitor_latency_init(struct monitor_latency *latency)
+{
+	os_atomic_set_long(&latency->max_latency, MONITOR_DEFAULT_MAX_LATENCY);
+	os_atomic_set_long(&latency->policy, LATENCY_POLICY_COMPRESS);
+	os_atomic_set_long(&latency->discarded_frames, 0);
+}
+
+static inline void monitor_latency_set(struct monitor_latency *latency, long long max_latency, int policy)
+{
+	os_atomic_set_long(&latency->max_latency, max_latency > 0 ? (long)max_latency : 0);
+	os_atomic_set_long(&latency->policy, policy);
+}
+
+static inline uint64_t monitor_latency_get_discarded_ms(struct monitor_latency *latency, uint32_t samples_per_sec)
+{
+	if (!samples_per_sec)
+		return 0;
+	return (uint64_t)os_atomic_load_long(&latency->discarded_frames) * 1000 / samples_per_sec;
+}
+
+/* Allocates the crossfade buffers when a monitor starts, fade_frames of frame_size bytes each */
+static inline void monitor_latency_start(struct monitor_latency *latency, size_t fade_frames, size_t frame_size)
+{
+	latency->fade_frames = fade_frames;
+	latency->fade_from = bzalloc(fade_frames * frame_size);
+	latency->fade_to = bzalloc(fade_frames * frame_size);
+}
+
+static inline void monitor_latency_stop(struct monitor_latency *latency)
+{
+	bfree(latency->fade_from);
+	latency->fade_from = NULL;
+	bfree(latency->fade_to);
+	latency->fade_to = NULL;
+	latency->fade_frames = 0;
+}
+
+/* Linear crossfade from fade_from to fade_to, used to hide the jump when audio is skipped */
+static inline void monitor_crossfade(const struct monitor_latency *latency, float *output, size_t frames, size_t channels)
+{
+	for (size_t frame = 0; frame < frames; frame++) {
+		const float t = (float)(frame + 1) / (float)(frames + 1);
+		const size_t first = frame * channels;
+		for (size_t i = first; i < first + channels; i++)
+			output[i] = latency->fade_from[i] * (1.0f - t) + latency->fade_to[i] * t;
+	}
+}
+
+/* Reads size bytes from the ring, discarding audio first when the backlog is above the latency ceiling */
+static inline size_t monitor_ring_read(struct audio_ring *ring, struct monitor_latency *latency, uint32_t samples_per_sec,
+				       uint8_t *buffer, size_t size)
+{
+	const size_t frame_size = ring->frame_size;
+	const size_t ceiling = (size_t)os_atomic_load_long(&latency->max_latency) * samples_per_sec / 1000 * frame_size;
+	const size_t backlog = audio_ring_size(ring);
+	if (!ceiling || backlog <= size + ceiling)
+		return audio_ring_read(ring, buffer, size);
+
+	const size_t excess = backlog - size - ceiling;
+	size_t discarded = 0;
+	switch (os_atomic_load_long(&latency->policy)) {
+	case LATENCY_POLICY_RESYNC:
+		// Jump back to live, keep only what is needed for this read.
+		discarded = audio_ring_skip(ring, backlog - size);
+		break;
+	case LATENCY_POLICY_COMPRESS:
+		if (excess <= ceiling) {
+			// Skip up to a quarter of this read and crossfade over the cut.
+			const size_t frames = size / frame_size;
+			size_t skip_frames = excess / frame_size;
+			if (skip_frames > frames / 4)
+				skip_frames = frames / 4;
+			size_t fade = latency->fade_frames;
+			if (fade > frames / 2)
+				fade = frames / 2;
+			if (!skip_frames || !fade)
+				break;
+
+			const size_t head = (frames - fade) * frame_size;
+			audio_ring_read(ring, buffer, head);
+			audio_ring_peek(ring, latency->fade_from, fade * frame_size, 0);
+			audio_ring_peek(ring, latency->fade_to, fade * frame_size, skip_frames * frame_size);
+			audio_ring_skip(ring, (fade + skip_frames) * frame_size);
+			monitor_crossfade(latency, (float *)(buffer + head), fade, frame_size / sizeof(float));
+			os_atomic_add_long(&latency->discarded_frames, (long)skip_frames);
+			return size;
+		}
+		// Too far behind to catch up smoothly, drop like drop oldest.
+		discarded = audio_ring_skip(ring, excess);
+		break;
+	case LATENCY_POLICY_DROP_OLDEST:
+	default:
+		discarded = audio_ring_skip(ring, excess);
+		break;
+	}
+	if (discarded)
+		os_atomic_add_long(&latency->discarded_frames, (long)(discarded / frame_size));
+	return audio_ring_read(ring, buffer, size);
+}
+
+/* Writes frames into the ring without a copy, through the matrix when there is one and then the EQ and limiter when
+ * there is one. Whatever does not fit is counted as discarded. */
+static inline void monitor_ring_write(struct audio_ring *ring, struct monitor_latency *latency,
+				      const struct audio_dsp_matrix *matrix, struct audio_dsp_eq_limiter *eq_limiter,
+				      const float *samples, size_t frames)
+{
+	const size_t frame_size = ring->frame_size;
+	const size_t channels = frame_size / sizeof(float);
+	const size_t bytes = frame_size * frames;
+	uint8_t *regions[2];
+	size_t sizes[2];
+	const size_t reserved = audio_ring_reserve(ring, bytes, regions, sizes);
+	for (size_t i = 0; i < 2; i++) {
+		const size_t region_frames = sizes[i] / frame_size;
+		if (matrix)
+			audio_dsp_apply(matrix, samples, (float *)regions[i], region_frames);
+		else
+			memcpy(regions[i], samples, sizes[i]);
+		if (eq_limiter)
+			audio_dsp_eq_limiter_process(eq_limiter, (float *)regions[i], region_frames);
+		samples += region_frames * channels;
+	}
+	audio_ring_commit(ring, reserved);
+	if (reserved < bytes)
+		os_atomic_add_long(&latency->discarded_frames, (long)((bytes - reserved) / frame_size));
+}
@@ -1,4 +1,5 @@
 #include "audio-monitor-win.h"
+#include "audio-dsp.h"
 
 #include <obs.h>
 #include <media-io/audio-resampler.h>
@@ -26,10 +27,21 @@ struct audio_monitor {
 	IAudioRenderClient *render;
 	uint32_t sample_rate;
 	uint32_t channels;
-	audio_resampler_t *resampler;
+	struct audio_dsp_resampler *resampler;
+	/* monitors of the same stream share the conversion of each block */
+	const void *shared_stream;
+	/* audio_dsp_resampler_quality used from the next start */
+	int resampler_quality;
 	float volume;
 	bool mono;
 	float balance;
+	/* only this pair of channels is played when above 0 */
+	int channel_pair;
+	/* volume, mono, balance and channel pair as a channel matrix, only touched by the thread that processes audio */
+	struct audio_dsp_matrix matrix;
+	/* monitor only EQ and limiter, built from the settings by the thread that processes audio */
+	struct audio_dsp_eq_limiter_settings eq_limiter_settings;
+	struct audio_dsp_eq_limiter eq_limiter;
 	pthread_mutex_t mutex;
 	char *device_id;
 	char *source_name;
@@ -38,6 +50,13 @@ struct audio_monitor {
 	uint32_t nuFrame;
 	byte sr;
 	enum audio_format format;
+	/* VBAN audio after the matrix, in float and in the packet format when that is not float */
+	float *processed;
+	size_t processed_size;
+	audio_dsp_convert_func convert;
+	uint8_t *packed;
+	size_t packed_size;
+	struct audio_dsp_dither dither;
 	long long samples_per_sec;
 };
 
@@ -75,8 +94,9 @@ void audio_monitor_stop(struct audio_monitor *audio_monitor)
 	audio_monitor->client = NULL;
 	safe_release(audio_monitor->render);
 	audio_monitor->render = NULL;
-	audio_resampler_destroy(audio_monitor->resampler);
+	audio_dsp_resampler_destroy(audio_monitor->resampler);
 	audio_monitor->resampler = NULL;
+	audio_dsp_eq_limiter_reset(&audio_monitor->eq_limiter);
 	pthread_mutex_unlock(&audio_monitor->mutex);
 }
 
@@ -211,11 +231,14 @@ void audio_monitor_start(struct audio_monitor *audio_monitor)
 		}
 
 		to.samples_per_sec = (uint32_t)audio_monitor->samples_per_sec;
+		audio_monitor->sample_rate = to.samples_per_sec;
 		to.speakers = info->speakers;
-		to.format = audio_monitor->format;
+		to.format = AUDIO_FORMAT_FLOAT;
+		audio_monitor->convert = audio_dsp_get_convert(audio_monitor->format);
 	}
 
-	audio_monitor->resampler = audio_resampler_create(&to, &from);
+	audio_monitor->resampler = audio_dsp_resampler_create(&to, &from, audio_monitor->resampler_quality,
+							      audio_monitor->shared_stream);
 	pthread_mutex_unlock(&audio_monitor->mutex);
 }
 
@@ -228,137 +251,20 @@ void audio_monitor_audio(void *data, struct obs_audio_data *audio)
 	if (!audio_monitor->resampler || pthread_mutex_trylock(&audio_monitor->mutex) != 0)
 		return;
 
-	uint8_t *resample_data[MAX_AV_PLANES];
+	const uint8_t *resample_data[MAX_AV_PLANES];
 	uint32_t resample_frames;
 	uint64_t ts_offset;
-	bool success = audio_resampler_resample(audio_monitor->resampler, resample_data, &resample_frames, &ts_offset,
-						(const uint8_t *const *)audio->data, (uint32_t)audio->frames);
+	bool success = audio_dsp_resampler_resample(audio_monitor->resampler, resample_data, &resample_frames, &ts_offset,
+						    (const uint8_t *const *)audio->data, (uint32_t)audio->frames, audio->timestamp);
 	if (!success) {
 		pthread_mutex_unlock(&audio_monitor->mutex);
 		return;
 	}
-	/* apply volume */
-	float vol = audio_monitor->volume;
-	if (!close_float(vol, 1.0f, EPSILON)) {
-		if (audio_monitor->format == AUDIO_FORMAT_FLOAT) {
-			register float *cur = (float *)resample_data[0];
-			register float *end = cur + resample_frames * audio_monitor->channels;
-
-			while (cur < end)
-				*(cur++) *= vol;
-		} else if (audio_monitor->format == AUDIO_FORMAT_32BIT) {
-			register int32_t *cur = (int32_t *)resample_data[0];
-			register int32_t *end = cur + resample_frames * audio_monitor->channels;
-
-			while (cur < end) {
-				*cur = (int32_t)((float)*cur * vol);
-				cur++;
-			}
-		} else if (audio_monitor->format == AUDIO_FORMAT_16BIT) {
-			register int16_t *cur = (int16_t *)resample_data[0];
-			register int16_t *end = cur + resample_frames * audio_monitor->channels;
-
-			while (cur < end) {
-				*cur = (int16_t)((float)*cur * vol);
-				cur++;
-			}
-		} else if (audio_monitor->format == AUDIO_FORMAT_U8BIT) {
-			register uint8_t *cur = resample_data[0];
-			register uint8_t *end = cur + resample_frames * audio_monitor->channels;
-
-			while (cur < end) {
-				*cur = (uint8_t)((float)*cur * vol);
-				cur++;
-			}
-		}
-	}
-	if (audio_monitor->mono && audio_monitor->channels > 1) {
-		if (audio_monitor->format == AUDIO_FORMAT_FLOAT) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				float avg = 0.0f;
-				for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-					avg += ((float *)resample_data[0])[frame * audio_monitor->channels + channel];
-				}
-				avg /= (float)audio_monitor->channels;
-				for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-					((float *)resample_data[0])[frame * audio_monitor->channels + channel] = avg;
-				}
-			}
-		} else if (audio_monitor->format == AUDIO_FORMAT_32BIT) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				int64_t avg = 0;
-				for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-					avg += ((int32_t *)resample_data[0])[frame * audio_monitor->channels + channel];
-				}
-				avg /= audio_monitor->channels;
-				for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-					((int32_t *)resample_data[0])[frame * audio_monitor->channels + channel] = (int32_t)avg;
-				}
-			}
-		} else if (audio_monitor->format == AUDIO_FORMAT_16BIT) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				int64_t avg = 0;
-				for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-					avg += ((int16_t *)resample_data[0])[frame * audio_monitor->channels + channel];
-				}
-				avg /= audio_monitor->channels;
-				for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-					((int16_t *)resample_data[0])[frame * audio_monitor->channels + channel] = (int16_t)avg;
-				}
-			}
-		} else if (audio_monitor->format == AUDIO_FORMAT_U8BIT) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				uint64_t avg = 0;
-				for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-					avg += ((uint8_t *)resample_data[0])[frame * audio_monitor->channels + channel];
-				}
-				avg /= audio_monitor->channels;
-				for (uint32_t channel = 0; channel < audio_monitor->channels; channel++) {
-					((uint8_t *)resample_data[0])[frame * audio_monitor->channels + channel] = (uint8_t)avg;
-				}
-			}
-		}
-	}
-	float bal = (audio_monitor->balance + 1.0f) / 2.0f;
-	if (!close_float(bal, 0.5f, EPSILON) && audio_monitor->channels > 1) {
-		if (audio_monitor->format == AUDIO_FORMAT_FLOAT) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				((float *)resample_data[0])[frame * audio_monitor->channels + 0] =
-					((float *)resample_data[0])[frame * audio_monitor->channels + 0] *
-					sinf((1.0f - bal) * (M_PI / 2.0f));
-				((float *)resample_data[0])[frame * audio_monitor->channels + 1] =
-					((float *)resample_data[0])[frame * audio_monitor->channels + 1] *
-					sinf(bal * (M_PI / 2.0f));
-			}
-		} else if (audio_monitor->format == AUDIO_FORMAT_32BIT) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				((int32_t *)resample_data[0])[frame * audio_monitor->channels + 0] =
-					(int32_t)((float)((int32_t *)resample_data[0])[frame * audio_monitor->channels + 0] *
-						  sinf((1.0f - bal) * (M_PI / 2.0f)));
-				((int32_t *)resample_data[0])[frame * audio_monitor->channels + 1] =
-					(int32_t)((float)((int32_t *)resample_data[0])[frame * audio_monitor->channels + 1] *
-						  sinf(bal * (M_PI / 2.0f)));
-			}
-		} else if (audio_monitor->format == AUDIO_FORMAT_16BIT) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				((int16_t *)resample_data[0])[frame * audio_monitor->channels + 0] =
-					(int16_t)((float)((int16_t *)resample_data[0])[frame * audio_monitor->channels + 0] *
-						  sinf((1.0f - bal) * (M_PI / 2.0f)));
-				((int16_t *)resample_data[0])[frame * audio_monitor->channels + 1] =
-					(int16_t)((float)((int16_t *)resample_data[0])[frame * audio_monitor->channels + 1] *
-						  sinf(bal * (M_PI / 2.0f)));
-			}
-		} else if (audio_monitor->format == AUDIO_FORMAT_U8BIT) {
-			for (uint32_t frame = 0; frame < resample_frames; frame++) {
-				((uint8_t *)resample_data[0])[frame * audio_monitor->channels + 0] =
-					(uint8_t)((float)((uint8_t *)resample_data[0])[frame * audio_monitor->channels + 0] *
-						  sinf((1.0f - bal) * (M_PI / 2.0f)));
-				((uint8_t *)resample_data[0])[frame * audio_monitor->channels + 1] =
-					(uint8_t)((float)((uint8_t *)resample_data[0])[frame * audio_monitor->channels + 1] *
-						  sinf(bal * (M_PI / 2.0f)));
-			}
-		}
-	}
+	// Other monitors can read the same resampled audio, the matrix leaves it as is and writes to the output.
+	audio_dsp_matrix_update(&audio_monitor->matrix, audio_monitor->channels, audio_monitor->volume, audio_monitor->mono,
+				audio_monitor->balance, audio_monitor->channel_pair);
+	audio_dsp_eq_limiter_update(&audio_monitor->eq_limiter, &audio_monitor->eq_limiter_settings, audio_monitor->channels,
+				    audio_monitor->sample_rate);
 
 	if (audio_monitor->sock) {
 
@@ -370,6 +276,29 @@ void audio_monitor_audio(void *data, struct obs_audio_data *audio)
 		} else {
 			sample_size *= 4;
 		}
+
+		// Processing is all float, other VBAN formats get one clamped conversion at the end.
+		const size_t samples = resample_frames * audio_monitor->channels;
+		if (audio_monitor->processed_size < samples) {
+			audio_monitor->processed = brealloc(audio_monitor->processed, samples * sizeof(float));
+			audio_monitor->processed_size = samples;
+		}
+		audio_dsp_apply(&audio_monitor->matrix, (const float *)resample_data[0], audio_monitor->processed, resample_frames);
+		audio_dsp_eq_limiter_process(&audio_monitor->eq_limiter, audio_monitor->processed, resample_frames);
+		const uint8_t *packed = (const uint8_t *)audio_monitor->processed;
+		if (audio_monitor->format != AUDIO_FORMAT_FLOAT) {
+			const size_t size = sample_size * resample_frames;
+			if (audio_monitor->packed_size < size) {
+				audio_monitor->packed = brealloc(audio_monitor->packed, size);
+				audio_monitor->packed_size = size;
+			}
+			// 32 bit is finer than float, dither would only add noise.
+			const bool dither = audio_monitor->format != AUDIO_FORMAT_32BIT;
+			audio_monitor->convert(audio_monitor->processed, audio_monitor->packed, samples,
+					       dither ? &audio_monitor->dither : NULL);
+			packed = audio_monitor->packed;
+		}
+
 		size_t frames_per_packet = 1436 / sample_size;
 		for (size_t pos = 0; pos < resample_frames; pos += frames_per_packet) {
 			size_t msg_length = 28 + sample_size * (pos + frames_per_packet <= resample_frames ? frames_per_packet
@@ -403,7 +332,7 @@ void audio_monitor_audio(void *data, struct obs_audio_data *audio)
 			memcpy(msg + 24, &audio_monitor->nuFrame, sizeof(uint32_t));
 			audio_monitor->nuFrame++;
 
-			memcpy(msg + 28, resample_data[0] + pos * sample_size, msg_length - 28);
+			memcpy(msg + 28, packed + pos * sample_size, msg_length - 28);
 			int result = sendto(audio_monitor->sock, msg, (int)msg_length, 0,
 					    (struct sockaddr *)&audio_monitor->addrDest, sizeof(audio_monitor->addrDest));
 			bfree(msg);
@@ -428,7 +357,8 @@ void audio_monitor_audio(void *data, struct obs_audio_data *audio)
 		return;
 	}
 
-	memcpy(output, resample_data[0], resample_frames * audio_monitor->channels * sizeof(float));
+	audio_dsp_apply(&audio_monitor->matrix, (const float *)resample_data[0], (float *)output, resample_frames);
+	audio_dsp_eq_limiter_process(&audio_monitor->eq_limiter, (float *)output, resample_frames);
 	audio_monitor->render->lpVtbl->ReleaseBuffer(audio_monitor->render, resample_frames, 0);
 	pthread_mutex_unlock(&audio_monitor->mutex);
 }
@@ -454,6 +384,34 @@ void audio_monitor_set_balance(struct audio_monitor *audio_monitor, float balanc
 	audio_monitor->balance = balance;
 }
 
+void audio_monitor_set_channel_pair(struct audio_monitor *audio_monitor, int channel_pair)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->channel_pair = channel_pair;
+}
+
+void audio_monitor_set_stream(struct audio_monitor *audio_monitor, const void *stream)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->shared_stream = stream;
+}
+
+void audio_monitor_set_resampler_quality(struct audio_monitor *audio_monitor, int quality)
+{
+	if (!audio_monitor)
+		return;
+	audio_monitor->resampler_quality = quality;
+}
+
+void audio_monitor_set_eq_limiter(struct audio_monitor *audio_monitor, const struct audio_dsp_eq_limiter_settings *settings)
+{
+	if (!audio_monitor || !settings)
+		return;
+	audio_monitor->eq_limiter_settings = *settings;
+}
+
 int resolvehelper(const char *hostname, int family, const char *service, struct sockaddr_storage *pAddr)
 {
 	int result;
@@ -479,6 +437,7 @@ struct audio_monitor *audio_monitor_create(const char *device_id, const char *so
 	audio_monitor->source_name = bstrdup(source_name);
 	audio_monitor->volume = 1.0f;
 	audio_monitor->format = AUDIO_FORMAT_FLOAT;
+	audio_dsp_dither_init(&audio_monitor->dither, (uint32_t)os_gettime_ns());
 	pthread_mutex_init(&audio_monitor->mutex, NULL);
 	if (port) {
 		char buffer[10];
@@ -496,6 +455,8 @@ void audio_monitor_destroy(struct audio_monitor *audio_monitor)
 	audio_monitor_stop(audio_monitor);
 	if (audio_monitor->sock)
 		closesocket(audio_monitor->sock);
+	bfree(audio_monitor->processed);
+	bfree(audio_monitor->packed);
 	bfree(audio_monitor->source_name);
 	bfree(audio_monitor->device_id);
 	bfree(audio_monitor);
@@ -529,3 +490,47 @@ void audio_monitor_set_samples_per_sec(struct audio_monitor *audio_monitor, long
 		audio_monitor_start(audio_monitor);
 	}
 }
+
+void audio_monitor_set_max_latency(struct audio_monitor *audio_monitor, long long max_latency, int policy)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(max_latency);
+	UNUSED_PARAMETER(policy);
+}
+
+uint64_t audio_monitor_get_discarded_ms(struct audio_monitor *audio_monitor)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	return 0;
+}
+
+void audio_monitor_set_latency_profile(struct audio_monitor *audio_monitor, int profile, long long custom_ms)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(profile);
+	UNUSED_PARAMETER(custom_ms);
+}
+
+uint64_t audio_monitor_get_latency_ms(struct audio_monitor *audio_monitor)
+{
+	// Only the resampler and the limiter are known, the delay of the device is not.
+	if (!audio_monitor)
+		return 0;
+	pthread_mutex_lock(&audio_monitor->mutex);
+	const uint64_t processing_ns = audio_dsp_resampler_get_latency_ns(audio_monitor->resampler) +
+				       audio_dsp_eq_limiter_get_latency_ns(&audio_monitor->eq_limiter);
+	pthread_mutex_unlock(&audio_monitor->mutex);
+	return processing_ns / 1000000;
+}
+
+void audio_monitor_set_server_volume(struct audio_monitor *audio_monitor, bool server_volume)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(server_volume);
+}
+
+void audio_monitor_set_direct_source(struct audio_monitor *audio_monitor, const char *source)
+{
+	UNUSED_PARAMETER(audio_monitor);
+	UNUSED_PARAMETER(source);
+}
@@ -4,50 +4,10 @@
 #include <QVBoxLayout>
 #include <QPushButton>
 #include "utils.hpp"
+#include "audio-dsp.h"
 #include "obs-module.h"
 #include "media-io/audio-math.h"
 
-/* msb(h, g, f, e) lsb(d, c, b, a)   -->  msb(h, h, g, f) lsb(e, d, c, b)
- */
-#define SHIFT_RIGHT_2PS(msb, lsb)                                               \
-	{                                                                       \
-		__m128 tmp = _mm_shuffle_ps(lsb, msb, _MM_SHUFFLE(0, 0, 3, 3)); \
-		lsb = _mm_shuffle_ps(lsb, tmp, _MM_SHUFFLE(2, 1, 2, 1));        \
-		msb = _mm_shuffle_ps(msb, msb, _MM_SHUFFLE(3, 3, 2, 1));        \
-	}
-
-/* x4(d, c, b, a)  -->  max(a, b, c, d)
- */
-#define hmax_ps(r, x4)                     \
-	do {                               \
-		float x4_mem[4];           \
-		_mm_storeu_ps(x4_mem, x4); \
-		r = x4_mem[0];             \
-		r = fmaxf(r, x4_mem[1]);   \
-		r = fmaxf(r, x4_mem[2]);   \
-		r = fmaxf(r, x4_mem[3]);   \
-	} while (false)
-
-/* x(d, c, b, a) --> (|d|, |c|, |b|, |a|)
- */
-#define abs_ps(v) _mm_andnot_ps(_mm_set1_ps(-0.f), v)
-
-/* Take cross product of a vector with a matrix resulting in vector.
- */
-#define VECTOR_MATRIX_CROSS_PS(out, v, m0, m1, m2, m3)    \
-	{                                                 \
-		out = _mm_mul_ps(v, m0);                  \
-		__m128 mul1 = _mm_mul_ps(v, m1);          \
-		__m128 mul2 = _mm_mul_ps(v, m2);          \
-		__m128 mul3 = _mm_mul_ps(v, m3);          \
-                                                          \
-		_MM_TRANSPOSE4_PS(out, mul1, mul2, mul3); \
-                                                          \
-		out = _mm_add_ps(out, mul1);              \
-		out = _mm_add_ps(out, mul2);              \
-		out = _mm_add_ps(out, mul3);              \
-	}
-
 AudioOutputControl::AudioOutputControl(int track, obs_data_t *settings) : track(track)
 {
 	int audio_channels = 2;
@@ -76,7 +36,7 @@ AudioOutputControl::AudioOutputControl(int track, obs_data_t *settings) : track(
 				char *id = (char *)obs_data_get_string(device, "id");
 				d.device_id = id;
 				d.device_name = NULL;
-				obs_enum_audio_monitoring_devices(updateFilterName, &d);
+				audio_monitor_enum_output_devices(updateFilterName, &d);
 				char *dn = (char *)obs_data_get_string(device, "deviceName");
 				if (d.device_name) {
 					if (strcmp(dn, d.device_name) != 0) {
@@ -86,7 +46,7 @@ AudioOutputControl::AudioOutputControl(int track, obs_data_t *settings) : track(
 				} else if (strlen(dn)) {
 					d.device_id = NULL;
 					d.device_name = dn;
-					obs_enum_audio_monitoring_devices(updateFilterId, &d);
+					audio_monitor_enum_output_devices(updateFilterId, &d);
 					if (d.device_id) {
 						if (strcmp(id, d.device_id) != 0) {
 							obs_data_set_string(device, "id", d.device_id);
@@ -100,6 +60,7 @@ AudioOutputControl::AudioOutputControl(int track, obs_data_t *settings) : track(
 					audio_monitor *monitor = audio_monitor_create(QT_TO_UTF8(device_id),
 										      obs_data_get_string(device, "deviceName"), 0);
 					audio_monitor_set_volume(monitor, 1.0f);
+					audio_monitor_set_stream(monitor, this);
 					audio_monitor_start(monitor);
 					audioDevices[device_id] = monitor;
 				}
@@ -141,78 +102,8 @@ void AudioOutputControl::OBSOutputAudio(void *param, size_t mix_idx, struct audi
 			continue;
 		}
 
-		/* volmeter->prev_samples may not be aligned to 16 bytes;
-		 * use unaligned load. */
-		__m128 previous_samples = _mm_loadu_ps(control->prev_samples[channel_nr]);
-
-		/* These are normalized-sinc parameters for interpolating over sample
-		* points which are located at x-coords: -1.5, -0.5, +0.5, +1.5.
-		* And oversample points at x-coords: -0.3, -0.1, 0.1, 0.3. */
-		const __m128 m3 = _mm_set_ps(-0.155915f, 0.935489f, 0.233872f, -0.103943f);
-		const __m128 m1 = _mm_set_ps(-0.216236f, 0.756827f, 0.504551f, -0.189207f);
-		const __m128 p1 = _mm_set_ps(-0.189207f, 0.504551f, 0.756827f, -0.216236f);
-		const __m128 p3 = _mm_set_ps(-0.103943f, 0.233872f, 0.935489f, -0.155915f);
-
-		__m128 work = previous_samples;
-		__m128 peak = previous_samples;
-		for (size_t i = 0; (i + 3) < nr_samples; i += 4) {
-			__m128 new_work = _mm_loadu_ps(&samples[i]);
-			__m128 intrp_samples;
-
-			/* Include the actual sample values in the peak. */
-			__m128 abs_new_work = abs_ps(new_work);
-			peak = _mm_max_ps(peak, abs_new_work);
-
-			/* Shift in the next point. */
-			SHIFT_RIGHT_2PS(new_work, work);
-			VECTOR_MATRIX_CROSS_PS(intrp_samples, work, m3, m1, p1, p3);
-			peak = _mm_max_ps(peak, abs_ps(intrp_samples));
-
-			SHIFT_RIGHT_2PS(new_work, work);
-			VECTOR_MATRIX_CROSS_PS(intrp_samples, work, m3, m1, p1, p3);
-			peak = _mm_max_ps(peak, abs_ps(intrp_samples));
-
-			SHIFT_RIGHT_2PS(new_work, work);
-			VECTOR_MATRIX_CROSS_PS(intrp_samples, work, m3, m1, p1, p3);
-			peak = _mm_max_ps(peak, abs_ps(intrp_samples));
-
-			SHIFT_RIGHT_2PS(new_work, work);
-			VECTOR_MATRIX_CROSS_PS(intrp_samples, work, m3, m1, p1, p3);
-			peak = _mm_max_ps(peak, abs_ps(intrp_samples));
-		}
-
-		float r;
-		hmax_ps(r, peak);
-
-		switch (nr_samples) {
-		case 0:
-			break;
-		case 1:
-			control->prev_samples[channel_nr][0] = control->prev_samples[channel_nr][1];
-			control->prev_samples[channel_nr][1] = control->prev_samples[channel_nr][2];
-			control->prev_samples[channel_nr][2] = control->prev_samples[channel_nr][3];
-			control->prev_samples[channel_nr][3] = samples[nr_samples - 1];
-			break;
-		case 2:
-			control->prev_samples[channel_nr][0] = control->prev_samples[channel_nr][2];
-			control->prev_samples[channel_nr][1] = control->prev_samples[channel_nr][3];
-			control->prev_samples[channel_nr][2] = samples[nr_samples - 2];
-			control->prev_samples[channel_nr][3] = samples[nr_samples - 1];
-			break;
-		case 3:
-			control->prev_samples[channel_nr][0] = control->prev_samples[channel_nr][3];
-			control->prev_samples[channel_nr][1] = samples[nr_samples - 3];
-			control->prev_samples[channel_nr][2] = samples[nr_samples - 2];
-			control->prev_samples[channel_nr][3] = samples[nr_samples - 1];
-			break;
-		default:
-			control->prev_samples[channel_nr][0] = samples[nr_samples - 4];
-			control->prev_samples[channel_nr][1] = samples[nr_samples - 3];
-			control->prev_samples[channel_nr][2] = samples[nr_samples - 2];
-			control->prev_samples[channel_nr][3] = samples[nr_samples - 1];
-		}
-
-		control->peak[channel_nr] = r;
+		control->peak[channel_nr] = audio_dsp_true_peak(samples, nr_samples, control->prev_samples[channel_nr]);
+		control->magnitude[channel_nr] = audio_dsp_magnitude(samples, nr_samples);
 
 		channel_nr++;
 	}
@@ -222,22 +113,6 @@ void AudioOutputControl::OBSOutputAudio(void *param, size_t mix_idx, struct audi
 		control->peak[channel_nr] = 0.0;
 	}
 
-	channel_nr = 0;
-	for (size_t plane_nr = 0; plane_nr < planes; plane_nr++) {
-		float *samples = (float *)data->data[plane_nr];
-		if (!samples) {
-			continue;
-		}
-
-		float sum = 0.0;
-		for (size_t i = 0; i < nr_samples; i++) {
-			float sample = samples[i];
-			sum += sample * sample;
-		}
-		control->magnitude[channel_nr] = sqrtf(sum / nr_samples);
-
-		channel_nr++;
-	}
 	float magnitude[MAX_AUDIO_CHANNELS];
 	float peak[MAX_AUDIO_CHANNELS];
 	float input_peak[MAX_AUDIO_CHANNELS];
@@ -354,6 +229,7 @@ void AudioOutputControl::AddDevice(QString device_id, QString device_name)
 	if (it == audioDevices.end()) {
 		audio_monitor *monitor = audio_monitor_create(QT_TO_UTF8(device_id), QT_TO_UTF8(device_name), 0);
 		audio_monitor_set_volume(monitor, 1.0f);
+		audio_monitor_set_stream(monitor, this);
 		audio_monitor_start(monitor);
 		audioDevices[device_id] = monitor;
 	}
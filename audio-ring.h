@@ -0,0 +1,166 @@
+#pragma once
+#include <string.h>
+#include <util/bmem.h>
+#include <util/threading.h>
+
+/* Fixed size single producer, single consumer byte ring.
+ * The producer only moves write_pos and the consumer only moves read_pos,
+ * so both sides can run on different threads without taking a lock.
+ * One frame is always kept free to tell a full ring from an empty one. */
+struct audio_ring {
+	uint8_t *data;
+	size_t capacity;
+	size_t frame_size;
+	volatile long read_pos;
+	volatile long write_pos;
+};
+
+static inline void audio_ring_init(struct audio_ring *ring, size_t frames, size_t frame_size)
+{
+	ring->frame_size = frame_size;
+	ring->capacity = (frames + 1) * frame_size;
+	ring->data = bzalloc(ring->capacity);
+	os_atomic_set_long(&ring->read_pos, 0);
+	os_atomic_set_long(&ring->write_pos, 0);
+}
+
+static inline void audio_ring_free(struct audio_ring *ring)
+{
+	bfree(ring->data);
+	ring->data = NULL;
+	ring->capacity = 0;
+	os_atomic_set_long(&ring->read_pos, 0);
+	os_atomic_set_long(&ring->write_pos, 0);
+}
+
+/* bytes ready to be read */
+static inline size_t audio_ring_size(struct audio_ring *ring)
+{
+	if (!ring->capacity)
+		return 0;
+	const size_t read_pos = (size_t)os_atomic_load_long(&ring->read_pos);
+	const size_t write_pos = (size_t)os_atomic_load_long(&ring->write_pos);
+	if (write_pos >= read_pos)
+		return write_pos - read_pos;
+	return ring->capacity - read_pos + write_pos;
+}
+
+/* bytes that can be written without overwriting unread data */
+static inline size_t audio_ring_free_space(struct audio_ring *ring)
+{
+	if (!ring->capacity)
+		return 0;
+	return ring->capacity - ring->frame_size - audio_ring_size(ring);
+}
+
+/* Producer side, writes whole frames only and returns the number of bytes written */
+static inline size_t audio_ring_write(struct audio_ring *ring, const void *data, size_t size)
+{
+	const size_t space = audio_ring_free_space(ring);
+	if (size > space)
+		size = space;
+	if (size && ring->frame_size)
+		size -= size % ring->frame_size;
+	if (!size)
+		return 0;
+
+	const size_t write_pos = (size_t)os_atomic_load_long(&ring->write_pos);
+	const size_t tail = ring->capacity - write_pos;
+	if (size <= tail) {
+		memcpy(ring->data + write_pos, data, size);
+	} else {
+		memcpy(ring->data + write_pos, data, tail);
+		memcpy(ring->data, (const uint8_t *)data + tail, size - tail);
+	}
+	os_atomic_set_long(&ring->write_pos, (long)((write_pos + size) % ring->capacity));
+	return size;
+}
+
+/* Producer side, hands out up to size bytes of free space as at most two regions to write in place,
+ * the consumer does not see any of it before audio_ring_commit */
+static inline size_t audio_ring_reserve(struct audio_ring *ring, size_t size, uint8_t *regions[2], size_t sizes[2])
+{
+	const size_t space = audio_ring_free_space(ring);
+	if (size > space)
+		size = space;
+	if (size && ring->frame_size)
+		size -= size % ring->frame_size;
+
+	const size_t write_pos = size ? (size_t)os_atomic_load_long(&ring->write_pos) : 0;
+	const size_t tail = ring->capacity - write_pos;
+	regions[0] = ring->data + write_pos;
+	sizes[0] = size < tail ? size : tail;
+	regions[1] = ring->data;
+	sizes[1] = size - sizes[0];
+	return size;
+}
+
+/* Producer side, publishes size bytes written into the regions from audio_ring_reserve */
+static inline void audio_ring_commit(struct audio_ring *ring, size_t size)
+{
+	if (!size)
+		return;
+	const size_t write_pos = (size_t)os_atomic_load_long(&ring->write_pos);
+	os_atomic_set_long(&ring->write_pos, (long)((write_pos + size) % ring->capacity));
+}
+
+/* Consumer side, returns the number of bytes read */
+static inline size_t audio_ring_read(struct audio_ring *ring, void *data, size_t size)
+{
+	const size_t available = audio_ring_size(ring);
+	if (size > available)
+		size = available;
+	if (size && ring->frame_size)
+		size -= size % ring->frame_size;
+	if (!size)
+		return 0;
+
+	const size_t read_pos = (size_t)os_atomic_load_long(&ring->read_pos);
+	const size_t tail = ring->capacity - read_pos;
+	if (size <= tail) {
+		memcpy(data, ring->data + read_pos, size);
+	} else {
+		memcpy(data, ring->data + read_pos, tail);
+		memcpy((uint8_t *)data + tail, ring->data, size - tail);
+	}
+	os_atomic_set_long(&ring->read_pos, (long)((read_pos + size) % ring->capacity));
+	return size;
+}
+
+/* Consumer side, copies data starting offset bytes after the read position without consuming it */
+static inline size_t audio_ring_peek(struct audio_ring *ring, void *data, size_t size, size_t offset)
+{
+	const size_t available = audio_ring_size(ring);
+	if (offset >= available)
+		return 0;
+	if (size > available - offset)
+		size = available - offset;
+	if (!size)
+		return 0;
+
+	const size_t pos = ((size_t)os_atomic_load_long(&ring->read_pos) + offset) % ring->capacity;
+	const size_t tail = ring->capacity - pos;
+	if (size <= tail) {
+		memcpy(data, ring->data + pos, size);
+	} else {
+		memcpy(data, ring->data + pos, tail);
+		memcpy((uint8_t *)data + tail, ring->data, size - tail);
+	}
+	return size;
+}
+
+/* Consumer side, discards data and returns the number of bytes discarded */
+static inline size_t audio_ring_skip(struct audio_ring *ring, size_t size)
+{
+	const size_t available = audio_ring_size(ring);
+	if (size > available)
+		size = available;
+	if (size && ring->frame_size)
+		size -= size % ring->frame_size;
+	if (!size)
+		return 0;
+
+	const size_t read_pos = (size_t)os_atomic_load_long(&ring->read_pos);
+	os_atomic_set_long(&ring->read_pos, (long)((read_pos + size) % ring->capacity));
+	return size;
+}
@@ -0,0 +1,365 @@
+#include "audio-dsp.h"
+#include <obs.h>
+#include <media-io/audio-resampler.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Times the stages audio_monitor_audio runs in every backend, interleaving or resampling the mix, the channel matrix,
+ * the monitor EQ and limiter and the conversion to the format of the device, and the meter of the dock, over channel
+ * counts, block sizes and formats. Every row reports ns per frame and the bytes read and written per second, so a
+ * regression shows up as a row that got slower. Pass a word to only run the rows whose name contains it, like
+ * "convert" or "peak 2ch". */
+
+/* Frames every row processes, split in blocks of the size of the row */
+#define BENCHMARK_TOTAL_FRAMES (1 << 22)
+#define BENCHMARK_MAX_BLOCK 4096
+
+static const uint32_t benchmark_channels[] = {1, 2, 6, 8};
+static const size_t benchmark_blocks[] = {64, 256, 1024, BENCHMARK_MAX_BLOCK};
+#define BENCHMARK_COUNT(array) (sizeof(array) / sizeof(array[0]))
+
+static const char *benchmark_filter = NULL;
+
+static bool benchmark_wanted(const char *name)
+{
+	return !benchmark_filter || strstr(name, benchmark_filter);
+}
+
+static void benchmark_report(const char *name, uint64_t elapsed, double frames, double bytes)
+{
+	printf("%-40s %9.3f ns/frame %8.2f GB/s\n", name, (double)elapsed / frames, bytes / (double)elapsed);
+}
+
+static float *benchmark_noise(size_t samples)
+{
+	float *noise = bmalloc(samples * sizeof(float));
+	for (size_t i = 0; i < samples; i++)
+		noise[i] = (float)rand() / (float)RAND_MAX - 0.5f;
+	return noise;
+}
+
+static enum speaker_layout benchmark_speakers(uint32_t channels)
+{
+	switch (channels) {
+	case 1:
+		return SPEAKERS_MONO;
+	case 6:
+		return SPEAKERS_5POINT1;
+	case 8:
+		return SPEAKERS_7POINT1;
+	default:
+		return SPEAKERS_STEREO;
+	}
+}
+
+/* The planar mix as OBS hands it to a filter */
+struct benchmark_planes {
+	float *planes[MAX_AV_PLANES];
+	const uint8_t *data[MAX_AV_PLANES];
+};
+
+static void benchmark_planes_init(struct benchmark_planes *planes, uint32_t channels, size_t frames)
+{
+	memset(planes, 0, sizeof(*planes));
+	for (uint32_t c = 0; c < channels; c++) {
+		planes->planes[c] = benchmark_noise(frames);
+		planes->data[c] = (const uint8_t *)planes->planes[c];
+	}
+}
+
+static void benchmark_planes_free(struct benchmark_planes *planes)
+{
+	for (size_t c = 0; c < MAX_AV_PLANES; c++)
+		bfree(planes->planes[c]);
+}
+
+/* Output at the rate and layout of the mix, the resampler only interleaves */
+static void benchmark_interleave(uint32_t channels, size_t block)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "interleave %uch %zu", channels, block);
+	if (!benchmark_wanted(name))
+		return;
+
+	struct benchmark_planes planes;
+	benchmark_planes_init(&planes, channels, block);
+	const struct resample_info from = {48000, AUDIO_FORMAT_FLOAT_PLANAR, benchmark_speakers(channels)};
+	const struct resample_info to = {48000, AUDIO_FORMAT_FLOAT, benchmark_speakers(channels)};
+	struct audio_dsp_resampler *resampler = audio_dsp_resampler_create(&to, &from, AUDIO_DSP_RESAMPLER_LIBOBS, NULL);
+
+	const size_t iterations = BENCHMARK_TOTAL_FRAMES / block;
+	const uint64_t start = os_gettime_ns();
+	for (size_t i = 0; i < iterations; i++) {
+		const uint8_t *output[MAX_AV_PLANES];
+		uint32_t out_frames;
+		uint64_t ts_offset;
+		audio_dsp_resampler_resample(resampler, output, &out_frames, &ts_offset, planes.data, (uint32_t)block, i);
+	}
+	const uint64_t elapsed = os_gettime_ns() - start;
+
+	const double frames = (double)block * (double)iterations;
+	benchmark_report(name, elapsed, frames, frames * channels * sizeof(float) * 2);
+	audio_dsp_resampler_destroy(resampler);
+	benchmark_planes_free(&planes);
+}
+
+/* The separate volume, mono and balance passes the backends used before audio-dsp */
+static void benchmark_three_pass(float *samples, size_t frames, uint32_t channels, float volume, bool mono, float balance)
+{
+	if (!close_float(volume, 1.0f, EPSILON)) {
+		register float *cur = samples;
+		register float *end = cur + frames * channels;
+
+		while (cur < end)
+			*(cur++) *= volume;
+	}
+
+	if (mono && channels > 1) {
+		for (size_t frame = 0; frame < frames; frame++) {
+			float avg = 0.0f;
+			for (uint32_t channel = 0; channel < channels; channel++)
+				avg += samples[frame * channels + channel];
+			avg /= (float)channels;
+			for (uint32_t channel = 0; channel < channels; channel++)
+				samples[frame * channels + channel] = avg;
+		}
+	}
+
+	float bal = (balance + 1.0f) / 2.0f;
+	if (!close_float(bal, 0.5f, EPSILON) && channels > 1) {
+		for (size_t frame = 0; frame < frames; frame++) {
+			samples[frame * channels + 0] = samples[frame * channels + 0] * sinf((1.0f - bal) * (M_PI / 2.0f));
+			samples[frame * channels + 1] = samples[frame * channels + 1] * sinf(bal * (M_PI / 2.0f));
+		}
+	}
+}
+
+/* Volume and balance are a gain per channel, mono mixes every channel into every output */
+static void benchmark_matrix(uint32_t channels, size_t block, bool mono)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "matrix %s %uch %zu", mono ? "mono" : "gain", channels, block);
+	if (!benchmark_wanted(name))
+		return;
+
+	float *input = benchmark_noise(block * channels);
+	float *output = bmalloc(block * channels * sizeof(float));
+	struct audio_dsp_matrix matrix = {0};
+
+	const size_t iterations = BENCHMARK_TOTAL_FRAMES / block;
+	const uint64_t start = os_gettime_ns();
+	for (size_t i = 0; i < iterations; i++) {
+		audio_dsp_matrix_update(&matrix, channels, 0.9f, mono, 0.25f, 0);
+		audio_dsp_apply(&matrix, input, output, block);
+	}
+	const uint64_t elapsed = os_gettime_ns() - start;
+
+	const double frames = (double)block * (double)iterations;
+	const double bytes = frames * channels * sizeof(float) * 2;
+	benchmark_report(name, elapsed, frames, bytes);
+
+	// The old passes work in place, so they copy the block first to not end up in denormals.
+	snprintf(name, sizeof(name), "matrix %s %uch %zu three pass", mono ? "mono" : "gain", channels, block);
+	const uint64_t reference_start = os_gettime_ns();
+	for (size_t i = 0; i < iterations; i++) {
+		memcpy(output, input, block * channels * sizeof(float));
+		benchmark_three_pass(output, block, channels, 0.9f, mono, 0.25f);
+	}
+	benchmark_report(name, os_gettime_ns() - reference_start, frames, bytes);
+
+	bfree(output);
+	bfree(input);
+}
+
+/* The last step of every backend, float to the format of the device */
+static void benchmark_convert(enum audio_format format, bool dither, uint32_t channels, size_t block)
+{
+	const char *formats[] = {"unknown", "u8", "s16", "s32", "float"};
+	char name[64];
+	snprintf(name, sizeof(name), "convert %s%s %uch %zu", formats[format], dither ? " dither" : "", channels, block);
+	if (!benchmark_wanted(name))
+		return;
+
+	const size_t samples = block * channels;
+	float *input = benchmark_noise(samples);
+	uint8_t *output = bmalloc(samples * get_audio_bytes_per_channel(format));
+	audio_dsp_convert_func convert = audio_dsp_get_convert(format);
+	struct audio_dsp_dither state;
+	audio_dsp_dither_init(&state, 1);
+
+	const size_t iterations = BENCHMARK_TOTAL_FRAMES / block;
+	const uint64_t start = os_gettime_ns();
+	for (size_t i = 0; i < iterations; i++)
+		convert(input, output, samples, dither ? &state : NULL);
+	const uint64_t elapsed = os_gettime_ns() - start;
+
+	const double frames = (double)block * (double)iterations;
+	benchmark_report(name, elapsed, frames,
+			 frames * channels * (double)(sizeof(float) + get_audio_bytes_per_channel(format)));
+	bfree(output);
+	bfree(input);
+}
+
+/* The monitor only EQ and limiter, in place on the output of the matrix. The second line is the share of one core a
+ * monitor at 48 kHz spends in it. */
+static void benchmark_eq_limiter(uint32_t channels, size_t block, bool limiter)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "eq%s %uch %zu", limiter ? " limiter" : "", channels, block);
+	if (!benchmark_wanted(name))
+		return;
+
+	// Loud enough for the limiter to work all the time.
+	float *input = benchmark_noise(block * channels);
+	for (size_t i = 0; i < block * channels; i++)
+		input[i] *= 4.0f;
+	float *output = bmalloc(block * channels * sizeof(float));
+	const struct audio_dsp_eq_limiter_settings settings = {
+		{3.0f, -2.0f, 4.0f}, {150.0f, 2500.0f, 8000.0f}, limiter, -1.0f, 100.0f};
+	struct audio_dsp_eq_limiter eq_limiter = {0};
+	audio_dsp_eq_limiter_update(&eq_limiter, &settings, channels, 48000);
+
+	// The EQ works in place, so it copies the block first like the matrix writes it.
+	const size_t iterations = BENCHMARK_TOTAL_FRAMES / block;
+	const uint64_t start = os_gettime_ns();
+	for (size_t i = 0; i < iterations; i++) {
+		memcpy(output, input, block * channels * sizeof(float));
+		audio_dsp_eq_limiter_process(&eq_limiter, output, block);
+	}
+	const uint64_t elapsed = os_gettime_ns() - start;
+
+	const double frames = (double)block * (double)iterations;
+	benchmark_report(name, elapsed, frames, frames * channels * sizeof(float) * 2);
+	printf("%-40s %9.3f %% of a core at 48 kHz\n", "", (double)elapsed / frames * 48000.0 / 1e7);
+	bfree(output);
+	bfree(input);
+}
+
+/* The libobs resampler against the presets of the polyphase one, on the blocks of 1024 frames OBS sends. The stub
+ * has no libswresample, built against it only the presets are timed. */
+static void benchmark_resample(uint32_t from_rate, uint32_t to_rate, int quality)
+{
+	const char *qualities[] = {"libobs", "fast", "balanced", "mastering"};
+	char name[64];
+	snprintf(name, sizeof(name), "resample %u>%u %s", from_rate, to_rate, qualities[quality]);
+	if (!benchmark_wanted(name))
+		return;
+
+	const size_t block = AUDIO_OUTPUT_FRAMES;
+	struct benchmark_planes planes;
+	benchmark_planes_init(&planes, 2, block);
+	const struct resample_info from = {from_rate, AUDIO_FORMAT_FLOAT_PLANAR, SPEAKERS_STEREO};
+	const struct resample_info to = {to_rate, AUDIO_FORMAT_FLOAT, SPEAKERS_STEREO};
+	struct audio_dsp_resampler *resampler = audio_dsp_resampler_create(&to, &from, quality, NULL);
+	if (!resampler) {
+		printf("%-40s not available\n", name);
+		benchmark_planes_free(&planes);
+		return;
+	}
+
+	const size_t iterations = BENCHMARK_TOTAL_FRAMES / block / 8;
+	uint64_t out_total = 0;
+	const uint64_t start = os_gettime_ns();
+	for (size_t i = 0; i < iterations; i++) {
+		const uint8_t *output[MAX_AV_PLANES];
+		uint32_t out_frames = 0;
+		uint64_t ts_offset;
+		audio_dsp_resampler_resample(resampler, output, &out_frames, &ts_offset, planes.data, (uint32_t)block, i);
+		out_total += out_frames;
+	}
+	const uint64_t elapsed = os_gettime_ns() - start;
+
+	const double frames = (double)block * (double)iterations;
+	benchmark_report(name, elapsed, frames, (frames + (double)out_total) * 2 * sizeof(float));
+	printf("%-40s %9.3f ms delay\n", "", (double)audio_dsp_resampler_get_latency_ns(resampler) / 1000000.0);
+	audio_dsp_resampler_destroy(resampler);
+	benchmark_planes_free(&planes);
+}
+
+/* What OBSOutputAudio of the dock does for every track, peak and magnitude of every plane */
+static void benchmark_peak(uint32_t channels, size_t block)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "peak %uch %zu", channels, block);
+	if (!benchmark_wanted(name))
+		return;
+
+	struct benchmark_planes planes;
+	benchmark_planes_init(&planes, channels, block);
+	float history[MAX_AUDIO_CHANNELS][4] = {{0}};
+	float peak[MAX_AUDIO_CHANNELS];
+	float magnitude[MAX_AUDIO_CHANNELS];
+
+	const size_t iterations = BENCHMARK_TOTAL_FRAMES / block;
+	const uint64_t start = os_gettime_ns();
+	for (size_t i = 0; i < iterations; i++) {
+		for (uint32_t c = 0; c < channels; c++) {
+			peak[c] = audio_dsp_true_peak(planes.planes[c], block, history[c]);
+			magnitude[c] = audio_dsp_magnitude(planes.planes[c], block);
+		}
+	}
+	const uint64_t elapsed = os_gettime_ns() - start;
+
+	const double frames = (double)block * (double)iterations;
+	benchmark_report(name, elapsed, frames, frames * channels * sizeof(float));
+	// Keep the results alive so the loop is not optimized away.
+	if (peak[0] < 0.0f || magnitude[0] < 0.0f)
+		printf("impossible\n");
+	benchmark_planes_free(&planes);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1)
+		benchmark_filter = argv[1];
+
+	audio_dsp_init();
+	printf("kernels: %s\n", audio_dsp_get_kernel_name());
+
+	for (size_t c = 0; c < BENCHMARK_COUNT(benchmark_channels); c++) {
+		for (size_t b = 0; b < BENCHMARK_COUNT(benchmark_blocks); b++)
+			benchmark_interleave(benchmark_channels[c], benchmark_blocks[b]);
+	}
+
+	for (size_t c = 0; c < BENCHMARK_COUNT(benchmark_channels); c++) {
+		for (size_t b = 0; b < BENCHMARK_COUNT(benchmark_blocks); b++) {
+			benchmark_matrix(benchmark_channels[c], benchmark_blocks[b], false);
+			if (benchmark_channels[c] > 1)
+				benchmark_matrix(benchmark_channels[c], benchmark_blocks[b], true);
+		}
+	}
+
+	const enum audio_format formats[] = {AUDIO_FORMAT_U8BIT, AUDIO_FORMAT_16BIT, AUDIO_FORMAT_32BIT, AUDIO_FORMAT_FLOAT};
+	for (size_t f = 0; f < BENCHMARK_COUNT(formats); f++) {
+		for (size_t c = 0; c < BENCHMARK_COUNT(benchmark_channels); c++) {
+			for (size_t b = 0; b < BENCHMARK_COUNT(benchmark_blocks); b++) {
+				benchmark_convert(formats[f], false, benchmark_channels[c], benchmark_blocks[b]);
+				if (formats[f] != AUDIO_FORMAT_FLOAT)
+					benchmark_convert(formats[f], true, benchmark_channels[c], benchmark_blocks[b]);
+			}
+		}
+	}
+
+	for (size_t c = 0; c < BENCHMARK_COUNT(benchmark_channels); c++) {
+		for (size_t b = 0; b < BENCHMARK_COUNT(benchmark_blocks); b++) {
+			benchmark_eq_limiter(benchmark_channels[c], benchmark_blocks[b], false);
+			benchmark_eq_limiter(benchmark_channels[c], benchmark_blocks[b], true);
+		}
+	}
+
+	const uint32_t rates[][2] = {{44100, 48000}, {48000, 44100}, {48000, 96000}};
+	for (size_t r = 0; r < BENCHMARK_COUNT(rates); r++) {
+		for (int quality = AUDIO_DSP_RESAMPLER_LIBOBS; quality <= AUDIO_DSP_RESAMPLER_MASTERING; quality++)
+			benchmark_resample(rates[r][0], rates[r][1], quality);
+	}
+
+	for (size_t c = 0; c < BENCHMARK_COUNT(benchmark_channels); c++) {
+		for (size_t b = 0; b < BENCHMARK_COUNT(benchmark_blocks); b++)
+			benchmark_peak(benchmark_channels[c], benchmark_blocks[b]);
+	}
+	return 0;
+}
@@ -0,0 +1,63 @@
+#include <obs.h>
+#include <media-io/audio-resampler.h>
+#include <util/platform.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+void *bmalloc(size_t size)
+{
+	return malloc(size ? size : 1);
+}
+
+void *brealloc(void *ptr, size_t size)
+{
+	return realloc(ptr, size ? size : 1);
+}
+
+void bfree(void *ptr)
+{
+	free(ptr);
+}
+
+void blog(int log_level, const char *format, ...)
+{
+	UNUSED_PARAMETER(log_level);
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fputc('\n', stderr);
+}
+
+uint64_t os_gettime_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+audio_resampler_t *audio_resampler_create(const struct resample_info *dst, const struct resample_info *src)
+{
+	UNUSED_PARAMETER(dst);
+	UNUSED_PARAMETER(src);
+	return NULL;
+}
+
+void audio_resampler_destroy(audio_resampler_t *resampler)
+{
+	UNUSED_PARAMETER(resampler);
+}
+
+bool audio_resampler_resample(audio_resampler_t *resampler, uint8_t *output[], uint32_t *out_frames, uint64_t *ts_offset,
+			      const uint8_t *const input[], uint32_t in_frames)
+{
+	UNUSED_PARAMETER(resampler);
+	UNUSED_PARAMETER(output);
+	UNUSED_PARAMETER(out_frames);
+	UNUSED_PARAMETER(ts_offset);
+	UNUSED_PARAMETER(input);
+	UNUSED_PARAMETER(in_frames);
+	return false;
+}
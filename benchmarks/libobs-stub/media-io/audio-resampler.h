@@ -0,0 +1,25 @@
+#pragma once
+#include "audio-io.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct audio_resampler;
+typedef struct audio_resampler audio_resampler_t;
+
+struct resample_info {
+	uint32_t samples_per_sec;
+	enum audio_format format;
+	enum speaker_layout speakers;
+};
+
+/* There is no libswresample in the stub, create always fails */
+audio_resampler_t *audio_resampler_create(const struct resample_info *dst, const struct resample_info *src);
+void audio_resampler_destroy(audio_resampler_t *resampler);
+bool audio_resampler_resample(audio_resampler_t *resampler, uint8_t *output[], uint32_t *out_frames, uint64_t *ts_offset,
+			      const uint8_t *const input[], uint32_t in_frames);
+
+#ifdef __cplusplus
+}
+#endif
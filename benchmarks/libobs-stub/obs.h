@@ -0,0 +1,19 @@
+#pragma once
+/* The parts of libobs the audio-dsp kernels and the benchmarks use, so they build without OBS installed.
+ * Declarations match libobs, libobs-stub.c has the implementations. */
+#include <math.h>
+#include "util/c99defs.h"
+#include "util/base.h"
+#include "util/bmem.h"
+#include "media-io/audio-io.h"
+
+/* from graphics/math-defs.h */
+#ifndef M_PI
+#define M_PI 3.1415926535897932384626433832795
+#endif
+#define EPSILON 1e-4f
+
+static inline bool close_float(float f1, float f2, float precision)
+{
+	return fabsf(f1 - f2) <= precision;
+}
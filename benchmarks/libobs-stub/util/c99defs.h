@@ -0,0 +1,6 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define UNUSED_PARAMETER(param) (void)param
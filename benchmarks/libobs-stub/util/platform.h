@@ -0,0 +1,12 @@
+#pragma once
+#include "c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint64_t os_gettime_ns(void);
+
+#ifdef __cplusplus
+}
+#endif
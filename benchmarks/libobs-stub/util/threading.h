@@ -0,0 +1,4 @@
+#pragma once
+/* libobs uses w32-pthreads on Windows, the stub only builds where pthreads is native */
+#include <pthread.h>
+#include "c99defs.h"